@@ -0,0 +1,90 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+// Bump allocator for short-lived structures with a common lifetime, such as the build side of one
+// query or the string lookups of one load chunk. It is a std::pmr::memory_resource, so std::pmr
+// containers take it directly. Memory comes from large anonymous mappings (with transparent huge
+// pages where allowed, which keeps the probe's lookups in few TLB entries) and is handed out in
+// allocation order; deallocate() does nothing, and everything is returned at once by release() or
+// the destructor, one munmap per block. Allocations are serialized by a mutex, which containers that
+// grow geometrically rarely contend on.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+
+class Arena : public std::pmr::memory_resource {
+public:
+    // Blocks start at `block_bytes` and double up to MAX_BLOCK_BYTES; requests larger than a
+    // quarter of the next block get a block of their own
+    static constexpr size_t DEFAULT_BLOCK_BYTES = 64 << 10;
+    static constexpr size_t MAX_BLOCK_BYTES = 64 << 20;
+
+    explicit Arena(size_t block_bytes = DEFAULT_BLOCK_BYTES) : next_block_bytes_(block_bytes) {}
+    ~Arena() override { release(); }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Frees every block. Containers using the arena must be destroyed (or never used again) first.
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& block : blocks_) ::munmap(block.first, block.second);
+        blocks_.clear();
+        cursor_ = end_ = nullptr;
+        reserved_ = 0;
+    }
+
+    // Bytes mapped for blocks so far
+    size_t bytesReserved() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return reserved_;
+    }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor_) + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        if (cursor_ && aligned + bytes <= reinterpret_cast<uintptr_t>(end_)) {
+            cursor_ = reinterpret_cast<char*>(aligned + bytes);
+            return reinterpret_cast<void*>(aligned);
+        }
+        // Mappings are page aligned, which satisfies any alignment a container asks for
+        if (bytes > next_block_bytes_ / 4) return mapBlock(bytes);
+        char* block = static_cast<char*>(mapBlock(next_block_bytes_));
+        cursor_ = block + bytes;
+        end_ = block + next_block_bytes_;
+        next_block_bytes_ = std::min(next_block_bytes_ * 2, MAX_BLOCK_BYTES);
+        return block;
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    // Caller holds mutex_
+    void* mapBlock(size_t bytes) {
+        void* block = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED) throw std::bad_alloc();
+        if (bytes >= HUGE_PAGE_BYTES) ::madvise(block, bytes, MADV_HUGEPAGE);
+        blocks_.emplace_back(block, bytes);
+        reserved_ += bytes;
+        return block;
+    }
+
+    static constexpr size_t HUGE_PAGE_BYTES = 2 << 20;
+
+    mutable std::mutex mutex_;
+    std::vector<std::pair<void*, size_t>> blocks_; // (address, length) of every mapping
+    char* cursor_ = nullptr;                        // free space of the current block is [cursor_, end_)
+    char* end_ = nullptr;
+    size_t next_block_bytes_;
+    size_t reserved_ = 0;
+};
+
+#endif // ARENA_HPP
@@ -0,0 +1,184 @@
+#ifndef KEY_FILTER_HPP
+#define KEY_FILTER_HPP
+
+// Approximate set of int32 join keys, tested before probing a KeyMap so that most non-matching
+// probe rows are rejected with a single bit test on a small, cache-resident structure.
+// Dense key sets (range at most BITMAP_RANGE_FACTOR times the number of keys) use an exact bitmap
+// over the key range; sparse ones use a blocked Bloom filter whose bits for a key all lie in one
+// 512-bit block. mayContain() never returns false for a key passed to build() or insert().
+// A KeyFilter is only modified by build() and insert(); between them mayContain() may be called
+// concurrently.
+
+#include "scheduler.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Representation of a KeyFilter: chosen by key density (Auto) or forced, e.g. to compare probe kernels
+enum class FilterLayout { Auto, Bitmap, Bloom };
+
+class KeyFilter {
+public:
+    // The bitmap is used while max_key - min_key + 1 <= BITMAP_RANGE_FACTOR * keys
+    static constexpr int64_t BITMAP_RANGE_FACTOR = 64;
+    // Bloom filter size per key; with 3 bits per key in 512-bit blocks this gives about 1% false positives
+    static constexpr size_t BLOOM_BITS_PER_KEY = 16;
+
+    // The words are allocated from `resource`; a copy-constructed filter uses the default resource
+    explicit KeyFilter(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : words_(resource) {}
+
+    // Replaces the contents with the keys of all `parts` (vectors of (key, value) entries, as
+    // passed to KeyMap::build), building with up to num_threads workers (one part at a time each)
+    template <typename Entry>
+    void build(const std::vector<std::pmr::vector<Entry>>& parts, int num_threads, FilterLayout layout = FilterLayout::Auto) {
+        words_.clear();
+        layout_ = layout;
+        const int workers = std::max(num_threads, 1);
+
+        size_t num_keys = 0;
+        int32_t min_key = INT32_MAX;
+        int32_t max_key = INT32_MIN;
+        std::vector<std::pair<int32_t, int32_t>> part_ranges(parts.size(), {INT32_MAX, INT32_MIN});
+        parallelForMorsels(workers, parts.size(), 1, [&](int, size_t begin, size_t end) {
+            for (size_t p = begin; p < end; ++p) {
+                for (const Entry& e : parts[p]) {
+                    part_ranges[p].first = std::min(part_ranges[p].first, e.first);
+                    part_ranges[p].second = std::max(part_ranges[p].second, e.first);
+                }
+            }
+        });
+        for (size_t p = 0; p < parts.size(); ++p) {
+            num_keys += parts[p].size();
+            min_key = std::min(min_key, part_ranges[p].first);
+            max_key = std::max(max_key, part_ranges[p].second);
+        }
+        num_keys_ = num_keys;
+        if (num_keys == 0) {
+            // An empty bitmap rejects every key
+            bitmap_mode_ = true;
+            min_key_ = 0;
+            num_bits_ = 0;
+            return;
+        }
+
+        const int64_t range = static_cast<int64_t>(max_key) - min_key + 1;
+        bitmap_mode_ = layout == FilterLayout::Auto ? range <= BITMAP_RANGE_FACTOR * static_cast<int64_t>(num_keys)
+                                                    : layout == FilterLayout::Bitmap;
+        if (bitmap_mode_) {
+            min_key_ = min_key;
+            num_bits_ = static_cast<size_t>(range);
+            words_.assign((num_bits_ + 63) / 64, 0);
+        } else {
+            size_t num_blocks = 1;
+            while (num_blocks * BLOCK_BITS < num_keys * BLOOM_BITS_PER_KEY) num_blocks <<= 1;
+            block_mask_ = num_blocks - 1;
+            words_.assign(num_blocks * BLOCK_WORDS, 0);
+        }
+
+        parallelForMorsels(workers, parts.size(), 1, [&](int, size_t begin, size_t end) {
+            for (size_t p = begin; p < end; ++p) {
+                for (const Entry& e : parts[p]) addKey(e.first);
+            }
+        });
+    }
+
+    // Adds the keys of all `parts` in place if the current words have room for them: a bitmap may
+    // extend its key range upward while it stays within BITMAP_RANGE_FACTOR of the key count (or at
+    // all if built with FilterLayout::Bitmap), a Bloom filter may take keys up to the count it was
+    // sized for. Otherwise returns false without changing anything, and the filter is to be rebuilt.
+    template <typename Entry>
+    bool insert(const std::vector<std::pmr::vector<Entry>>& parts) {
+        size_t num_keys = 0;
+        int32_t min_key = INT32_MAX;
+        int32_t max_key = INT32_MIN;
+        for (const auto& part : parts) {
+            num_keys += part.size();
+            for (const Entry& e : part) {
+                min_key = std::min(min_key, e.first);
+                max_key = std::max(max_key, e.first);
+            }
+        }
+        if (num_keys == 0) return true;
+
+        if (bitmap_mode_) {
+            if (num_bits_ == 0 || min_key < min_key_) return false;
+            const int64_t range = std::max(static_cast<int64_t>(num_bits_), static_cast<int64_t>(max_key) - min_key_ + 1);
+            if (layout_ != FilterLayout::Bitmap && range > BITMAP_RANGE_FACTOR * static_cast<int64_t>(num_keys_ + num_keys)) {
+                return false;
+            }
+            // resize() grows the words geometrically, so a run of appended keys is amortized
+            num_bits_ = static_cast<size_t>(range);
+            words_.resize((num_bits_ + 63) / 64, 0);
+        } else if ((num_keys_ + num_keys) * BLOOM_BITS_PER_KEY > words_.size() * 64) {
+            return false;
+        }
+        for (const auto& part : parts) {
+            for (const Entry& e : part) addKey(e.first);
+        }
+        num_keys_ += num_keys;
+        return true;
+    }
+
+    // False only if `key` was not passed to build()
+    bool mayContain(int32_t key) const { return bitmap_mode_ ? mayContainAs<true>(key) : mayContainAs<false>(key); }
+
+    // mayContain() compiled for one representation; BITMAP must equal isBitmap()
+    template <bool BITMAP>
+    bool mayContainAs(int32_t key) const {
+        if (BITMAP) {
+            const uint32_t bit = static_cast<uint32_t>(key) - static_cast<uint32_t>(min_key_);
+            return bit < num_bits_ && (words_[bit / 64] >> (bit % 64) & 1);
+        }
+        const uint64_t h = hash(key);
+        const uint64_t* block = &words_[blockIndex(h) * BLOCK_WORDS];
+        for (int k = 0; k < BLOOM_HASHES; ++k) {
+            const unsigned bit = bloomBit(h, k);
+            if (!(block[bit / 64] >> (bit % 64) & 1)) return false;
+        }
+        return true;
+    }
+
+    bool isBitmap() const { return bitmap_mode_; }
+    size_t sizeBytes() const { return words_.size() * sizeof(uint64_t); }
+
+private:
+    static constexpr size_t BLOCK_BITS = 512;
+    static constexpr size_t BLOCK_WORDS = BLOCK_BITS / 64;
+    static constexpr int BLOOM_HASHES = 3;
+
+    static uint64_t hash(int32_t key) {
+        // Same Fibonacci multiplier as KeyMap; bits 32+ pick the block, bits 5..31 the key's bits in it
+        return static_cast<uint64_t>(static_cast<uint32_t>(key)) * 0x9E3779B97F4A7C15ULL;
+    }
+    size_t blockIndex(uint64_t h) const { return static_cast<size_t>(h >> 32) & block_mask_; }
+    static unsigned bloomBit(uint64_t h, int k) { return static_cast<unsigned>(h >> (5 + 9 * k)) & (BLOCK_BITS - 1); }
+
+    // Parts may set bits in the same word, so build() sets bits with an atomic OR
+    void addKey(int32_t key) {
+        if (bitmap_mode_) {
+            const size_t bit = static_cast<size_t>(key - min_key_);
+            __atomic_fetch_or(&words_[bit / 64], uint64_t(1) << (bit % 64), __ATOMIC_RELAXED);
+        } else {
+            const uint64_t h = hash(key);
+            uint64_t* block = &words_[blockIndex(h) * BLOCK_WORDS];
+            for (int k = 0; k < BLOOM_HASHES; ++k) {
+                const unsigned bit = bloomBit(h, k);
+                __atomic_fetch_or(&block[bit / 64], uint64_t(1) << (bit % 64), __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    bool bitmap_mode_ = true;
+    FilterLayout layout_ = FilterLayout::Auto; // as passed to build()
+    int32_t min_key_ = 0;
+    size_t num_bits_ = 0;
+    size_t block_mask_ = 0;
+    size_t num_keys_ = 0; // keys added, counting duplicates
+    std::pmr::vector<uint64_t> words_;
+};
+
+#endif // KEY_FILTER_HPP
@@ -0,0 +1,251 @@
+#ifndef KEY_MAP_HPP
+#define KEY_MAP_HPP
+
+// Read-mostly map from int32 join keys to small payloads, used for the build side of hash joins.
+// TPC-H keys are dense, so when the key range is at most DIRECT_RANGE_FACTOR times the number of
+// entries the map is a direct-addressed array; otherwise it is an open-addressing hash table with
+// linear probing over a flat array of (key, value) slots.
+// A KeyMap is only modified by build() and insert(); between them it is read-only and find() may be
+// called concurrently.
+// Its arrays and the entry lists it is built from are std::pmr containers, so a query can place them
+// all in one Arena.
+
+#include "scheduler.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Array layout of a KeyMap: chosen by key density (Auto) or forced, e.g. to compare probe kernels
+enum class MapLayout { Auto, Direct, Hash };
+
+template <typename V>
+class KeyMap {
+public:
+    using Entry = std::pair<int32_t, V>;
+    using Entries = std::pmr::vector<Entry>;
+
+    // Direct addressing is used while max_key - min_key + 1 <= DIRECT_RANGE_FACTOR * entries
+    static constexpr int64_t DIRECT_RANGE_FACTOR = 8;
+    // Hash table slot marking an empty slot; this key cannot be stored in hash mode
+    static constexpr int32_t EMPTY_KEY = INT32_MIN;
+
+    // The arrays are allocated from `resource`; a copy-constructed map uses the default resource
+    explicit KeyMap(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : direct_(resource), slots_(resource) {}
+
+    // Replaces the contents with `entries`. Later duplicates overwrite earlier ones.
+    // `empty` is returned by find() for absent keys and must not be used as a value.
+    void build(const Entries& entries, V empty) {
+        build(std::vector<const Entries*>{&entries}, empty, 1);
+    }
+
+    // Replaces the contents with the entries of all `parts`, building with up to num_threads
+    // workers (one part at a time each). Keys should be unique: when several parts hold the same
+    // key, which of their values is kept is unspecified. A forced Direct layout allocates the whole
+    // key range whatever its density.
+    void build(const std::vector<Entries>& parts, V empty, int num_threads, MapLayout layout = MapLayout::Auto) {
+        std::vector<const Entries*> part_ptrs;
+        for (const auto& part : parts) part_ptrs.push_back(&part);
+        build(part_ptrs, empty, num_threads, layout);
+    }
+
+    void build(const std::vector<const Entries*>& parts, V empty, int num_threads, MapLayout layout = MapLayout::Auto) {
+        empty_ = empty;
+        layout_ = layout;
+        size_ = 0;
+        direct_.clear();
+        slots_.clear();
+        const int workers = std::max(num_threads, 1);
+
+        // Key range and entry count, reduced per part
+        size_t num_entries = 0;
+        int32_t min_key = INT32_MAX;
+        int32_t max_key = INT32_MIN;
+        std::vector<std::pair<int32_t, int32_t>> part_ranges(parts.size(), {INT32_MAX, INT32_MIN});
+        parallelForMorsels(workers, parts.size(), 1, [&](int, size_t begin, size_t end) {
+            for (size_t p = begin; p < end; ++p) {
+                for (const Entry& e : *parts[p]) {
+                    part_ranges[p].first = std::min(part_ranges[p].first, e.first);
+                    part_ranges[p].second = std::max(part_ranges[p].second, e.first);
+                }
+            }
+        });
+        for (size_t p = 0; p < parts.size(); ++p) {
+            num_entries += parts[p]->size();
+            min_key = std::min(min_key, part_ranges[p].first);
+            max_key = std::max(max_key, part_ranges[p].second);
+        }
+        if (num_entries == 0) {
+            direct_mode_ = true;
+            min_key_ = 0;
+            return;
+        }
+
+        const int64_t range = static_cast<int64_t>(max_key) - min_key + 1;
+        direct_mode_ = layout == MapLayout::Auto ? range <= DIRECT_RANGE_FACTOR * static_cast<int64_t>(num_entries)
+                                                 : layout == MapLayout::Direct;
+        std::vector<size_t> inserted(workers, 0);
+
+        if (direct_mode_) {
+            // Distinct keys map to distinct slots, so parts can be written concurrently
+            min_key_ = min_key;
+            direct_.assign(static_cast<size_t>(range), empty_);
+            parallelForMorsels(workers, parts.size(), 1, [&](int, size_t begin, size_t end) {
+                for (size_t p = begin; p < end; ++p) {
+                    for (const Entry& e : *parts[p]) direct_[static_cast<size_t>(e.first - min_key)] = e.second;
+                }
+            });
+            parallelForMorsels(workers, direct_.size(), MORSEL_ROWS, [&](int worker_id, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) inserted[worker_id] += direct_[i] != empty_;
+            });
+        } else {
+            size_t capacity = 16;
+            while (capacity < num_entries * 2) capacity <<= 1;
+            mask_ = capacity - 1;
+            slots_.assign(capacity, Slot{EMPTY_KEY, empty_});
+            // Lock-free insert: a slot is claimed by compare-and-swapping its key from EMPTY_KEY
+            parallelForMorsels(workers, parts.size(), 1, [&](int worker_id, size_t begin, size_t end) {
+                for (size_t p = begin; p < end; ++p) {
+                    for (const Entry& e : *parts[p]) {
+                        for (size_t i = hash(e.first) & mask_;; i = (i + 1) & mask_) {
+                            int32_t expected = EMPTY_KEY;
+                            if (__atomic_compare_exchange_n(&slots_[i].key, &expected, e.first, false,
+                                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                                ++inserted[worker_id];
+                            } else if (expected != e.first) {
+                                continue;
+                            }
+                            slots_[i].value = e.second;
+                            break;
+                        }
+                    }
+                }
+            });
+        }
+        for (size_t n : inserted) size_ += n;
+    }
+
+    // Adds the entries of all `parts` in place if the current array has room for them: a direct map
+    // may extend its key range upward while it stays within DIRECT_RANGE_FACTOR of the entry count
+    // (or at all if built with MapLayout::Direct), a hash table may fill up to half its slots.
+    // Otherwise returns false without changing anything, and the map is to be rebuilt with all entries.
+    // Later duplicates overwrite earlier ones.
+    bool insert(const std::vector<Entries>& parts) {
+        size_t num_entries = 0;
+        int32_t min_key = INT32_MAX;
+        int32_t max_key = INT32_MIN;
+        for (const auto& part : parts) {
+            num_entries += part.size();
+            for (const Entry& e : part) {
+                min_key = std::min(min_key, e.first);
+                max_key = std::max(max_key, e.first);
+            }
+        }
+        if (num_entries == 0) return true;
+
+        if (direct_mode_) {
+            if (direct_.empty() || min_key < min_key_) return false;
+            const int64_t range = std::max(static_cast<int64_t>(direct_.size()), static_cast<int64_t>(max_key) - min_key_ + 1);
+            if (layout_ != MapLayout::Direct && range > DIRECT_RANGE_FACTOR * static_cast<int64_t>(size_ + num_entries)) {
+                return false;
+            }
+            // resize() grows the array geometrically, so a run of appended keys is amortized
+            direct_.resize(static_cast<size_t>(range), empty_);
+            for (const auto& part : parts) {
+                for (const Entry& e : part) {
+                    V& value = direct_[static_cast<size_t>(e.first - min_key_)];
+                    size_ += value == empty_;
+                    value = e.second;
+                }
+            }
+        } else {
+            if (2 * (size_ + num_entries) > slots_.size()) return false;
+            for (const auto& part : parts) {
+                for (const Entry& e : part) {
+                    for (size_t i = hash(e.first) & mask_;; i = (i + 1) & mask_) {
+                        Slot& slot = slots_[i];
+                        if (slot.key != e.first && slot.key != EMPTY_KEY) continue;
+                        size_ += slot.key == EMPTY_KEY;
+                        slot = Slot{e.first, e.second};
+                        break;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Value stored for `key`, or the `empty` value given to build()
+    V find(int32_t key) const { return direct_mode_ ? findAs<true>(key) : findAs<false>(key); }
+
+    // find() compiled for one layout, for probe loops specialized on it; DIRECT must equal isDirect()
+    template <bool DIRECT>
+    V findAs(int32_t key) const {
+        if (DIRECT) {
+            const uint32_t offset = static_cast<uint32_t>(key) - static_cast<uint32_t>(min_key_);
+            return offset < direct_.size() ? direct_[offset] : empty_;
+        }
+        for (size_t i = hash(key) & mask_;; i = (i + 1) & mask_) {
+            const Slot& slot = slots_[i];
+            if (slot.key == key) return slot.value;
+            if (slot.key == EMPTY_KEY) return empty_;
+        }
+    }
+
+    // Index into the map's array where find(key) starts reading: the key's offset in direct mode
+    // (at least capacity() if it is out of range), its home slot in hash mode. Keys with nearby
+    // positions are looked up in nearby memory, which a partitioned probe uses to stay in cache.
+    uint64_t position(int32_t key) const {
+        if (direct_mode_) return static_cast<uint32_t>(key) - static_cast<uint32_t>(min_key_);
+        return hash(key) & mask_;
+    }
+
+    // Starts loading the cache line find(key) reads first, so that a batch of lookups can overlap
+    // their misses. Out-of-range keys of a direct map prefetch its last entry.
+    void prefetch(int32_t key) const { direct_mode_ ? prefetchAs<true>(key) : prefetchAs<false>(key); }
+
+    template <bool DIRECT>
+    void prefetchAs(int32_t key) const {
+        if (DIRECT) {
+            if (direct_.empty()) return;
+            const uint32_t offset = static_cast<uint32_t>(key) - static_cast<uint32_t>(min_key_);
+            __builtin_prefetch(&direct_[std::min<size_t>(offset, direct_.size() - 1)]);
+        } else if (!slots_.empty()) {
+            __builtin_prefetch(&slots_[hash(key) & mask_]);
+        }
+    }
+
+    // Length of the map's array, in entries
+    size_t capacity() const { return direct_mode_ ? direct_.size() : slots_.size(); }
+
+    bool isDirect() const { return direct_mode_; }
+    size_t size() const { return size_; }
+    size_t sizeBytes() const { return direct_.size() * sizeof(V) + slots_.size() * sizeof(Slot); }
+
+private:
+    struct Slot {
+        int32_t key;
+        V value;
+    };
+
+    static size_t hash(int32_t key) {
+        // Fibonacci hashing; the high bits are well mixed, so fold them down
+        const uint64_t h = static_cast<uint64_t>(static_cast<uint32_t>(key)) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+
+    bool direct_mode_ = true;
+    MapLayout layout_ = MapLayout::Auto; // as passed to build()
+    int32_t min_key_ = 0;
+    size_t size_ = 0;
+    size_t mask_ = 0;
+    V empty_ = V();
+    std::pmr::vector<V> direct_;
+    std::pmr::vector<Slot> slots_;
+};
+
+#endif // KEY_MAP_HPP
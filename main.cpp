@@ -0,0 +1,112 @@
+#include "query5.hpp"
+#include "numa.hpp"
+#include "profile.hpp"
+#include "thread_pool.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " --r_name <region> --start_date <YYYY-MM-DD> --end_date <YYYY-MM-DD>"
+              << " --threads <n> --table_path <dir> --result_path <file>\n"
+              << "       [--batch <file|->] [--cache_dir <dir>] [--stream] [--pin_threads] [--numa local|interleave]"
+              << " [--join auto|hash|radix|merge] [--refresh <file|->] [--profile]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string r_name, start_date, end_date, table_path, result_path;
+    int num_threads = 0;
+    RunOptions options;
+    if (!parseArgs(argc, argv, r_name, start_date, end_date, num_threads, table_path, result_path, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    // Placement must be set up before the tables are allocated and the pool starts its workers
+    if (!NumaPlacement::instance().configure(options.numa)) {
+        std::cerr << "NUMA placement is not available, continuing without it." << std::endl;
+    }
+    ThreadPool::instance().setPinning(options.pin_threads || NumaPlacement::instance().mode() != NumaMode::Off);
+    if (options.profile) Profiler::instance().enable();
+
+    auto start = std::chrono::steady_clock::now();
+    ColumnTable customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data;
+    // Streaming probes lineitem.tbl straight from disk, so only the build side is loaded
+    const std::vector<std::string>& projection = options.stream_lineitem ? QUERY5_BUILD_COLUMNS : QUERY5_COLUMNS;
+    if (!readTPCHData(table_path, customer_data, orders_data, lineitem_data, supplier_data, nation_data, region_data,
+                      num_threads, projection, options.cache_dir)) {
+        std::cerr << "Failed to read TPCH data." << std::endl;
+        return 1;
+    }
+    auto loaded = std::chrono::steady_clock::now();
+
+    bool ok;
+    if (!options.refresh_file.empty()) {
+        // The queries (one, or a batch) are kept current through every delta listed in the refresh file
+        std::vector<Query5Params> queries;
+        if (options.batch_file.empty()) {
+            queries.push_back({r_name, start_date, end_date});
+        } else {
+            std::ifstream batch_file;
+            if (options.batch_file != "-") {
+                batch_file.open(options.batch_file);
+                if (!batch_file.is_open()) {
+                    std::cerr << "Error opening batch file: " << options.batch_file << std::endl;
+                    return 1;
+                }
+            }
+            if (!readQuery5Batch(options.batch_file == "-" ? std::cin : batch_file, queries)) return 1;
+        }
+        std::ifstream refresh_file;
+        if (options.refresh_file != "-") {
+            refresh_file.open(options.refresh_file);
+            if (!refresh_file.is_open()) {
+                std::cerr << "Error opening refresh file: " << options.refresh_file << std::endl;
+                return 1;
+            }
+        }
+        ok = runQuery5Refresh(options.refresh_file == "-" ? std::cin : refresh_file, queries, !options.batch_file.empty(),
+                              result_path, num_threads, customer_data, orders_data, lineitem_data, supplier_data,
+                              nation_data, region_data, options.plan);
+    } else if (!options.batch_file.empty()) {
+        // A batch read from stdin is answered line by line; a batch file is run in shared scans
+        if (options.batch_file == "-") {
+            ok = runQuery5Batch(std::cin, result_path, num_threads, customer_data, orders_data, lineitem_data,
+                                supplier_data, nation_data, region_data, 1, options.plan);
+        } else {
+            std::ifstream queries(options.batch_file);
+            if (!queries.is_open()) {
+                std::cerr << "Error opening batch file: " << options.batch_file << std::endl;
+                return 1;
+            }
+            ok = runQuery5Batch(queries, result_path, num_threads, customer_data, orders_data, lineitem_data,
+                                supplier_data, nation_data, region_data, MAX_SHARED_QUERIES, options.plan);
+        }
+    } else {
+        std::map<std::string, Revenue> results;
+        if (options.stream_lineitem) {
+            const std::string lineitem_path = table_path + (table_path.back() == '/' ? "" : "/") + "lineitem.tbl";
+            std::vector<std::map<std::string, Revenue>> shared_results;
+            ok = executeQuery5Streaming(lineitem_path, {{r_name, start_date, end_date}}, num_threads, customer_data,
+                                        orders_data, supplier_data, nation_data, region_data, shared_results, options.plan);
+            if (ok) results = shared_results[0];
+        } else {
+            ok = executeQuery5(r_name, start_date, end_date, num_threads, customer_data, orders_data, lineitem_data,
+                               supplier_data, nation_data, region_data, results, options.plan);
+        }
+        if (!ok) {
+            std::cerr << "Failed to execute TPCH Query 5." << std::endl;
+        } else if (!outputResults(result_path, results)) {
+            std::cerr << "Failed to output results." << std::endl;
+            ok = false;
+        }
+    }
+    auto done = std::chrono::steady_clock::now();
+
+    // Timings go to stderr so that results written to stdout ("-") stay machine-readable
+    std::cerr << "Load time: " << std::chrono::duration<double>(loaded - start).count() << " s, query time: "
+              << std::chrono::duration<double>(done - loaded).count() << " s" << std::endl;
+    if (options.profile && !Profiler::instance().writeJson(profilePath(result_path), num_threads)) {
+        std::cerr << "Failed to write profile to " << profilePath(result_path) << std::endl;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+#include "numa.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#ifdef QUERY5_HAVE_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+NumaPlacement& NumaPlacement::instance() {
+    static NumaPlacement placement;
+    return placement;
+}
+
+NumaPlacement::NumaPlacement() : node_ids_{0}, node_cpus_(1) {}
+
+bool NumaPlacement::parseMode(const std::string& name, NumaMode& mode) {
+    if (name == "local") mode = NumaMode::Local;
+    else if (name == "interleave") mode = NumaMode::Interleave;
+    else return false;
+    return true;
+}
+
+bool NumaPlacement::configure(NumaMode mode) {
+    if (mode == NumaMode::Off) return true;
+#ifdef QUERY5_HAVE_LIBNUMA
+    if (::numa_available() < 0) return false;
+    std::vector<int> node_ids;
+    std::vector<std::vector<int>> node_cpus;
+    struct bitmask* cpus = ::numa_allocate_cpumask();
+    for (int node = 0; node <= ::numa_max_node(); ++node) {
+        // Memory-only nodes get no workers
+        if (::numa_node_to_cpus(node, cpus) != 0) continue;
+        std::vector<int> node_cpu_list;
+        for (unsigned cpu = 0; cpu < cpus->size; ++cpu) {
+            if (::numa_bitmask_isbitset(cpus, cpu)) node_cpu_list.push_back(static_cast<int>(cpu));
+        }
+        if (node_cpu_list.empty()) continue;
+        node_ids.push_back(node);
+        node_cpus.push_back(std::move(node_cpu_list));
+    }
+    ::numa_free_cpumask(cpus);
+    if (node_cpus.empty()) return false;
+
+    mode_ = mode;
+    node_ids_ = std::move(node_ids);
+    node_cpus_ = std::move(node_cpus);
+    if (mode == NumaMode::Interleave) ::numa_set_interleave_mask(::numa_all_nodes_ptr);
+
+    cpu_set_t caller_cpus;
+    CPU_ZERO(&caller_cpus);
+    for (int cpu : node_cpus_[0]) CPU_SET(cpu, &caller_cpus);
+    ::pthread_setaffinity_np(::pthread_self(), sizeof(caller_cpus), &caller_cpus);
+    return true;
+#else
+    return false;
+#endif
+}
+
+int NumaPlacement::workerCpu(int worker_id) const {
+    if (mode_ == NumaMode::Off) return -1;
+    // Consecutive workers alternate between nodes, so any worker count is spread evenly
+    const std::vector<int>& cpus = node_cpus_[workerNode(worker_id)];
+    return cpus[(worker_id / numNodes()) % cpus.size()];
+}
+
+void NumaPlacement::nodeRange(size_t total, size_t morsel_size, int node, int num_nodes, size_t& begin, size_t& end) {
+    const size_t num_morsels = (total + morsel_size - 1) / morsel_size;
+    begin = std::min(total, num_morsels * node / num_nodes * morsel_size);
+    end = std::min(total, num_morsels * (node + 1) / num_nodes * morsel_size);
+}
+
+void NumaPlacement::distribute(void* data, size_t count, size_t item_bytes, size_t morsel_size) const {
+    if (localNodes() <= 1 || count == 0) return;
+#ifdef QUERY5_HAVE_LIBNUMA
+    const uintptr_t page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    const uintptr_t base = reinterpret_cast<uintptr_t>(data);
+    struct bitmask* nodes = ::numa_allocate_nodemask();
+    for (int node = 0; node < numNodes(); ++node) {
+        size_t begin, end;
+        nodeRange(count, morsel_size, node, numNodes(), begin, end);
+        // A page shared by two runs goes to the later one; the last run takes its final partial page
+        const uintptr_t first = (base + begin * item_bytes) & ~(page - 1);
+        const uintptr_t last = node + 1 == numNodes() ? (base + end * item_bytes + page - 1) & ~(page - 1)
+                                                      : (base + end * item_bytes) & ~(page - 1);
+        if (first >= last) continue;
+        ::numa_bitmask_clearall(nodes);
+        ::numa_bitmask_setbit(nodes, static_cast<unsigned>(node_ids_[node]));
+        // Best effort: pages that cannot be moved (locked, shared) stay where they are
+        ::mbind(reinterpret_cast<void*>(first), last - first, MPOL_BIND, nodes->maskp, nodes->size + 1, MPOL_MF_MOVE);
+    }
+    ::numa_free_nodemask(nodes);
+#else
+    (void)data;
+    (void)item_bytes;
+    (void)morsel_size;
+#endif
+}
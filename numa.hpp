@@ -0,0 +1,62 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+// NUMA placement for --numa. In Local mode the probed table is split into one run of whole morsels
+// per node, each run's pages are moved to its node, and workers are pinned round-robin across nodes
+// (worker w runs on node w % numNodes()) and scan their own node's run before stealing from others.
+// Interleave mode spreads all later allocations over the nodes page by page and pins workers the
+// same way. Needs libnuma (QUERY5_HAVE_LIBNUMA); without it, or on a machine without NUMA support,
+// configure() fails for every mode but Off and placement stays the single-node default.
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class NumaMode {
+    Off,       // no placement; the kernel's default first-touch policy
+    Local,     // per-node runs of the probed table and per-node copies of the build side
+    Interleave // page-interleaved allocations
+};
+
+class NumaPlacement {
+public:
+    static NumaPlacement& instance();
+
+    // Parses a --numa value, "local" or "interleave"
+    static bool parseMode(const std::string& name, NumaMode& mode);
+
+    // Reads the topology and applies `mode`, pinning the calling thread (worker 0) to node 0.
+    // Call once before any allocation it should affect and before the ThreadPool starts workers.
+    bool configure(NumaMode mode);
+
+    NumaMode mode() const { return mode_; }
+
+    // Nodes with CPUs that workers are spread over; 1 unless configured
+    int numNodes() const { return static_cast<int>(node_cpus_.size()); }
+
+    // Nodes that per-node runs and build-side copies are made for: numNodes() in Local mode, else 1
+    int localNodes() const { return mode_ == NumaMode::Local ? numNodes() : 1; }
+
+    int workerNode(int worker_id) const { return worker_id % numNodes(); }
+
+    // CPU that worker_id is pinned to, or -1 if placement is off
+    int workerCpu(int worker_id) const;
+
+    // Items [begin, end) of the run of `node` when [0, total) is split into num_nodes runs of whole morsels
+    static void nodeRange(size_t total, size_t morsel_size, int node, int num_nodes, size_t& begin, size_t& end);
+
+    // Moves the pages of each node's run of an array of `count` items of `item_bytes` bytes to that
+    // node, with runs as in nodeRange. Does nothing unless localNodes() > 1.
+    void distribute(void* data, size_t count, size_t item_bytes, size_t morsel_size) const;
+
+private:
+    NumaPlacement();
+    NumaPlacement(const NumaPlacement&) = delete;
+    NumaPlacement& operator=(const NumaPlacement&) = delete;
+
+    NumaMode mode_ = NumaMode::Off;
+    std::vector<int> node_ids_;               // system id of each node used
+    std::vector<std::vector<int>> node_cpus_; // CPUs of each node used
+};
+
+#endif // NUMA_HPP
@@ -0,0 +1,162 @@
+#include "profile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+// Set once the calling thread's hardware counters have been opened (or found unavailable)
+thread_local bool counters_attached = false;
+
+int openCounter(uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Counts the calling thread on any CPU
+    return static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+const char* const COUNTER_NAMES[] = {"cycles", "llc_misses", "branch_misses"};
+const uint64_t COUNTER_CONFIGS[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+}
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::enable() {
+    enabled_.store(true, std::memory_order_relaxed);
+    attachThread();
+}
+
+void Profiler::disable() {
+    enabled_.store(false, std::memory_order_relaxed);
+}
+
+void Profiler::attachThread() {
+    if (counters_attached || !enabled()) return;
+    counters_attached = true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!counters_available_) return;
+    int fds[NUM_COUNTERS];
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+        fds[c] = openCounter(COUNTER_CONFIGS[c]);
+        if (fds[c] < 0) {
+            // Not permitted (perf_event_paranoid, containers) or not supported: report no counters at all
+            for (int i = 0; i < c; ++i) ::close(fds[i]);
+            counters_available_ = false;
+            return;
+        }
+    }
+    counter_fds_.insert(counter_fds_.end(), fds, fds + NUM_COUNTERS);
+}
+
+std::vector<uint64_t> Profiler::readCounters() const {
+    std::vector<uint64_t> values(counter_fds_.size(), 0);
+    for (size_t i = 0; i < counter_fds_.size(); ++i) {
+        uint64_t value = 0;
+        if (::read(counter_fds_[i], &value, sizeof(value)) == sizeof(value)) values[i] = value;
+    }
+    return values;
+}
+
+size_t Profiler::beginPhase(const std::string& name, uint64_t rows_in) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PhaseRecord phase;
+    phase.name = name;
+    phase.parent = open_.empty() ? -1 : static_cast<long>(open_.back());
+    phase.rows_in = rows_in;
+    phase.counter_start = readCounters();
+    phase.start = std::chrono::steady_clock::now();
+    phases_.push_back(std::move(phase));
+    open_.push_back(phases_.size() - 1);
+    return phases_.size() - 1;
+}
+
+void Profiler::endPhase(size_t id, uint64_t rows_out) {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    PhaseRecord& phase = phases_[id];
+    phase.wall_seconds = std::chrono::duration<double>(now - phase.start).count();
+    phase.rows_out = rows_out;
+    // Threads attached during the phase started counting from zero
+    const std::vector<uint64_t> values = readCounters();
+    for (size_t i = 0; i < values.size(); ++i) {
+        const uint64_t start = i < phase.counter_start.size() ? phase.counter_start[i] : 0;
+        phase.counters[i % NUM_COUNTERS] += values[i] - start;
+    }
+    open_.erase(std::find(open_.begin(), open_.end(), id));
+}
+
+void Profiler::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases_.clear();
+    open_.clear();
+}
+
+double Profiler::phaseSeconds(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    double seconds = 0;
+    for (const PhaseRecord& phase : phases_) {
+        if (phase.name == name) seconds += phase.wall_seconds;
+    }
+    return seconds;
+}
+
+void Profiler::addWorkerTime(int worker_id, double busy_seconds, uint64_t items) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (open_.empty()) return;
+    PhaseRecord& phase = phases_[open_.back()];
+    if (phase.workers.size() <= static_cast<size_t>(worker_id)) phase.workers.resize(worker_id + 1);
+    phase.workers[worker_id].busy_seconds += busy_seconds;
+    phase.workers[worker_id].items += items;
+}
+
+bool Profiler::writeJson(const std::string& path, int num_threads) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+    out << std::fixed << std::setprecision(6);
+    out << "{\n  \"threads\": " << num_threads << ",\n";
+    out << "  \"counters_available\": " << (counters_available_ && !counter_fds_.empty() ? "true" : "false") << ",\n";
+    out << "  \"phases\": [";
+    for (size_t p = 0; p < phases_.size(); ++p) {
+        const PhaseRecord& phase = phases_[p];
+        out << (p ? "," : "") << "\n    {\"id\": " << p << ", \"name\": \"" << phase.name << "\", \"parent\": " << phase.parent
+            << ", \"wall_seconds\": " << phase.wall_seconds << ", \"rows_in\": " << phase.rows_in
+            << ", \"rows_out\": " << phase.rows_out;
+        if (counters_available_ && !counter_fds_.empty()) {
+            out << ", \"counters\": {";
+            for (int c = 0; c < NUM_COUNTERS; ++c) {
+                out << (c ? ", " : "") << "\"" << COUNTER_NAMES[c] << "\": " << phase.counters[c];
+            }
+            out << "}";
+        }
+        if (!phase.workers.empty()) {
+            // Imbalance is the busiest worker's time over the mean; 1.0 is perfectly balanced
+            double max_busy = 0;
+            double total_busy = 0;
+            out << ", \"workers\": [";
+            for (size_t w = 0; w < phase.workers.size(); ++w) {
+                const WorkerRecord& worker = phase.workers[w];
+                max_busy = std::max(max_busy, worker.busy_seconds);
+                total_busy += worker.busy_seconds;
+                out << (w ? ", " : "") << "{\"id\": " << w << ", \"busy_seconds\": " << worker.busy_seconds
+                    << ", \"items\": " << worker.items << "}";
+            }
+            const double mean_busy = total_busy / static_cast<double>(phase.workers.size());
+            out << "], \"imbalance\": " << (mean_busy > 0 ? max_busy / mean_busy : 1.0);
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,106 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+// Optional per-phase instrumentation (--profile). A ProfilePhase scope records wall time and rows in
+// and out, plus cycles, LLC misses and branch misses summed over all threads where perf_event_open
+// is permitted. parallelForMorsels adds each worker's busy time and item count to the innermost
+// open phase, from which load imbalance is reported. Everything is a no-op while profiling is off.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Profiler {
+public:
+    static Profiler& instance();
+
+    // Starts recording phases. Hardware counters are opened for every thread that takes part.
+    void enable();
+    // Stops recording; phases already recorded are kept until reset()
+    void disable();
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Opens a phase nested in the innermost open one and returns its id
+    size_t beginPhase(const std::string& name, uint64_t rows_in);
+    void endPhase(size_t phase, uint64_t rows_out);
+
+    // Adds one worker's share of a parallel loop to the innermost open phase
+    void addWorkerTime(int worker_id, double busy_seconds, uint64_t items);
+
+    // Opens hardware counters for the calling thread if it has none yet
+    void attachThread();
+
+    // Discards the phases recorded so far, e.g. between benchmark iterations; no phase may be open
+    void reset();
+
+    // Total wall time of the closed phases named `name`
+    double phaseSeconds(const std::string& name) const;
+
+    // Writes all phases as JSON; returns false if the file cannot be written
+    bool writeJson(const std::string& path, int num_threads) const;
+
+private:
+    static const int NUM_COUNTERS = 3; // cycles, LLC misses, branch misses
+
+    struct WorkerRecord {
+        double busy_seconds = 0;
+        uint64_t items = 0;
+    };
+
+    struct PhaseRecord {
+        std::string name;
+        long parent = -1;
+        std::chrono::steady_clock::time_point start;
+        double wall_seconds = 0;
+        uint64_t rows_in = 0;
+        uint64_t rows_out = 0;
+        std::vector<WorkerRecord> workers; // by worker id
+        std::vector<uint64_t> counter_start; // by counter fd, values at beginPhase
+        uint64_t counters[NUM_COUNTERS] = {0, 0, 0};
+    };
+
+    Profiler() = default;
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    std::vector<uint64_t> readCounters() const;
+
+    std::atomic<bool> enabled_{false};
+    mutable std::mutex mutex_;
+    std::vector<PhaseRecord> phases_;
+    std::vector<size_t> open_; // stack of open phase ids
+    std::vector<int> counter_fds_; // NUM_COUNTERS per attached thread
+    bool counters_available_ = true;
+};
+
+// Scoped phase: begins on construction and ends on destruction or finish(), if profiling is enabled
+class ProfilePhase {
+public:
+    explicit ProfilePhase(const char* name, uint64_t rows_in = 0) : active_(Profiler::instance().enabled()) {
+        if (active_) id_ = Profiler::instance().beginPhase(name, rows_in);
+    }
+    ~ProfilePhase() {
+        if (active_) Profiler::instance().endPhase(id_, rows_out_);
+    }
+    ProfilePhase(const ProfilePhase&) = delete;
+    ProfilePhase& operator=(const ProfilePhase&) = delete;
+
+    void setRowsOut(uint64_t rows) { rows_out_ = rows; }
+
+    // Ends the phase before the end of its scope
+    void finish(uint64_t rows_out) {
+        if (active_) Profiler::instance().endPhase(id_, rows_out);
+        active_ = false;
+    }
+
+private:
+    bool active_;
+    size_t id_ = 0;
+    uint64_t rows_out_ = 0;
+};
+
+#endif // PROFILE_HPP
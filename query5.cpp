@@ -1,232 +1,1792 @@
-#include "query5.hpp"
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <thread>
-#include <mutex>
-#include <algorithm>
-#include <iomanip>
-#include <cstring>
-
-// Helper to split a string by a delimiter (needed for parsing the | separated files)
-std::vector<std::string> split(const std::string& s, char delimiter) {
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
-    }
-    return tokens;
-}
-
-// Function to parse command line arguments
-bool parseArgs(int argc, char* argv[], std::string& r_name, std::string& start_date, std::string& end_date, int& num_threads, std::string& table_path, std::string& result_path) {
-    for (int i = 1; i < argc; ++i) {
-        std::string arg = argv[i];
-        if (i + 1 < argc) { // Ensure there is a value after the flag
-            if (arg == "--r_name") r_name = argv[++i];
-            else if (arg == "--start_date") start_date = argv[++i];
-            else if (arg == "--end_date") end_date = argv[++i];
-            else if (arg == "--threads") num_threads = std::stoi(argv[++i]);
-            else if (arg == "--table_path") table_path = argv[++i];
-            else if (arg == "--result_path") result_path = argv[++i];
-        }
-    }
-    
-    // Basic validation to ensure we got the necessary args
-    if (r_name.empty() || start_date.empty() || end_date.empty() || table_path.empty() || result_path.empty() || num_threads <= 0) {
-        return false;
-    }
-    return true;
-}
-
-// Helper function to read a single .tbl file
-bool loadTable(const std::string& filepath, std::vector<std::map<std::string, std::string>>& table_data, const std::vector<std::string>& columns) {
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
-        std::cerr << "Error opening file: " << filepath << std::endl;
-        return false;
-    }
-
-    std::string line;
-    while (std::getline(file, line)) {
-        if (line.empty()) continue;
-        std::vector<std::string> values = split(line, '|');
-        if (values.size() < columns.size()) continue; 
-
-        std::map<std::string, std::string> row;
-        for (size_t i = 0; i < columns.size(); ++i) {
-            row[columns[i]] = values[i];
-        }
-        table_data.push_back(row);
-    }
-    return true;
-}
-
-// Function to read TPCH data from the specified paths
-bool readTPCHData(const std::string& table_path, 
-                  std::vector<std::map<std::string, std::string>>& customer_data, 
-                  std::vector<std::map<std::string, std::string>>& orders_data, 
-                  std::vector<std::map<std::string, std::string>>& lineitem_data, 
-                  std::vector<std::map<std::string, std::string>>& supplier_data, 
-                  std::vector<std::map<std::string, std::string>>& nation_data, 
-                  std::vector<std::map<std::string, std::string>>& region_data) {
-    
-    // Note: Ensure the column names match exactly what TPC-H provides and what logic expects
-    // File names are usually lowercase like region.tbl or uppercase REGION.tbl. Adjust path joining if needed.
-    // Using simple path concatenation. Ensure table_path ends with / or add it.
-    std::string path_suffix = (table_path.back() == '/' ? "" : "/");
-
-    if (!loadTable(table_path + path_suffix + "customer.tbl", customer_data, {"c_custkey", "c_name", "c_address", "c_nationkey", "c_phone", "c_acctbal", "c_mktsegment", "c_comment"})) return false;
-    if (!loadTable(table_path + path_suffix + "orders.tbl", orders_data, {"o_orderkey", "o_custkey", "o_orderstatus", "o_totalprice", "o_orderdate", "o_orderpriority", "o_clerk", "o_shippriority", "o_comment"})) return false;
-    if (!loadTable(table_path + path_suffix + "lineitem.tbl", lineitem_data, {"l_orderkey", "l_partkey", "l_suppkey", "l_linenumber", "l_quantity", "l_extendedprice", "l_discount", "l_tax", "l_returnflag", "l_linestatus", "l_shipdate", "l_commitdate", "l_receiptdate", "l_shipinstruct", "l_shipmode", "l_comment"})) return false;
-    if (!loadTable(table_path + path_suffix + "supplier.tbl", supplier_data, {"s_suppkey", "s_name", "s_address", "s_nationkey", "s_phone", "s_acctbal", "s_comment"})) return false;
-    if (!loadTable(table_path + path_suffix + "nation.tbl", nation_data, {"n_nationkey", "n_name", "n_regionkey", "n_comment"})) return false;
-    if (!loadTable(table_path + path_suffix + "region.tbl", region_data, {"r_regionkey", "r_name", "r_comment"})) return false;
-
-    return true;
-}
-
-// Function to execute TPCH Query 5 using multithreading
-bool executeQuery5(const std::string& r_name, const std::string& start_date, const std::string& end_date, int num_threads, 
-                   const std::vector<std::map<std::string, std::string>>& customer_data, 
-                   const std::vector<std::map<std::string, std::string>>& orders_data, 
-                   const std::vector<std::map<std::string, std::string>>& lineitem_data, 
-                   const std::vector<std::map<std::string, std::string>>& supplier_data, 
-                   const std::vector<std::map<std::string, std::string>>& nation_data, 
-                   const std::vector<std::map<std::string, std::string>>& region_data, 
-                   std::map<std::string, double>& results) {
-
-    // 1. Filter Regions (Find Region Key for r_name, e.g., 'ASIA')
-    std::vector<std::string> valid_region_keys;
-    for (const auto& r : region_data) {
-        if (r.at("r_name") == r_name) {
-            valid_region_keys.push_back(r.at("r_regionkey"));
-        }
-    }
-
-    // 2. Filter Nations (Find Nations in those Regions)
-    std::map<std::string, std::string> nation_key_to_name; // Map Key -> Name
-    for (const auto& n : nation_data) {
-        for (const auto& r_key : valid_region_keys) {
-            if (n.at("n_regionkey") == r_key) {
-                nation_key_to_name[n.at("n_nationkey")] = n.at("n_name");
-            }
-        }
-    }
-
-    // 3. Filter Customers (Find Customers in those Nations)
-    // Map CustKey -> NationKey (Only for valid nations)
-    std::map<std::string, std::string> valid_customers; 
-    for (const auto& c : customer_data) {
-        if (nation_key_to_name.find(c.at("c_nationkey")) != nation_key_to_name.end()) {
-            valid_customers[c.at("c_custkey")] = c.at("c_nationkey");
-        }
-    }
-    
-    // 4. Filter Suppliers (Find Suppliers in those Nations)
-    // Map SuppKey -> NationKey
-    std::map<std::string, std::string> valid_suppliers;
-    for (const auto& s : supplier_data) {
-        if (nation_key_to_name.find(s.at("s_nationkey")) != nation_key_to_name.end()) {
-            valid_suppliers[s.at("s_suppkey")] = s.at("s_nationkey");
-        }
-    }
-
-    // 5. Filter Orders (Match valid Customers and Date Range)
-    // Map OrderKey -> CustomerKey
-    std::map<std::string, std::string> valid_orders;
-    for (const auto& o : orders_data) {
-        std::string o_date = o.at("o_orderdate");
-        // Check date range and if customer is valid
-        if (o_date >= start_date && o_date < end_date) {
-            std::string c_key = o.at("o_custkey");
-            if (valid_customers.find(c_key) != valid_customers.end()) {
-                valid_orders[o.at("o_orderkey")] = c_key;
-            }
-        }
-    }
-
-    // 6. Process Lineitems (The heavy lifting - Multithreaded)
-    std::vector<std::thread> threads;
-    std::vector<std::map<std::string, double>> thread_results(num_threads);
-    std::mutex result_mutex;
-
-    size_t total_items = lineitem_data.size();
-    size_t chunk_size = total_items / num_threads;
-
-    auto worker = [&](int thread_id, size_t start_idx, size_t end_idx) {
-        for (size_t i = start_idx; i < end_idx; ++i) {
-            const auto& item = lineitem_data[i];
-            std::string o_key = item.at("l_orderkey");
-            std::string s_key = item.at("l_suppkey");
-
-            // Check if order is valid
-            auto o_it = valid_orders.find(o_key);
-            if (o_it != valid_orders.end()) {
-                // Check if supplier is valid
-                auto s_it = valid_suppliers.find(s_key);
-                if (s_it != valid_suppliers.end()) {
-                    
-                    std::string c_key = o_it->second; // Customer Key from Order
-                    std::string c_nation = valid_customers[c_key]; // Nation from Customer
-                    std::string s_nation = s_it->second; // Nation from Supplier
-
-                    // Condition: c_nationkey = s_nationkey
-                    if (c_nation == s_nation) {
-                        double price = std::stod(item.at("l_extendedprice"));
-                        double discount = std::stod(item.at("l_discount"));
-                        double revenue = price * (1.0 - discount);
-
-                        std::string n_name = nation_key_to_name[s_nation];
-                        thread_results[thread_id][n_name] += revenue;
-                    }
-                }
-            }
-        }
-    };
-
-    // Launch threads
-    for (int i = 0; i < num_threads; ++i) {
-        size_t start = i * chunk_size;
-        size_t end = (i == num_threads - 1) ? total_items : (i + 1) * chunk_size;
-        threads.emplace_back(worker, i, start, end);
-    }
-
-    // Join threads
-    for (auto& t : threads) {
-        t.join();
-    }
-
-    // Aggregate results
-    for (const auto& partial_map : thread_results) {
-        for (const auto& pair : partial_map) {
-            results[pair.first] += pair.second;
-        }
-    }
-
-    return true;
-}
-
-// Function to output results to the specified path
-bool outputResults(const std::string& result_path, const std::map<std::string, double>& results) {
-    std::ofstream outfile(result_path);
-    if (!outfile.is_open()) return false;
-
-    // Sort by revenue descending (Query requirement)
-    // Copy map to vector of pairs for sorting
-    std::vector<std::pair<std::string, double>> sorted_results(results.begin(), results.end());
-    
-    std::sort(sorted_results.begin(), sorted_results.end(), 
-        [](const std::pair<std::string, double>& a, const std::pair<std::string, double>& b) {
-            return a.second > b.second; // Descending order
-        });
-
-    // Write to file
-    for (const auto& pair : sorted_results) {
-        outfile << pair.first << "|" << std::fixed << std::setprecision(4) << pair.second << std::endl;
-    }
-    
-    outfile.close();
-    return true;
-}
\ No newline at end of file
+#include "query5.hpp"
+#include "arena.hpp"
+#include "key_filter.hpp"
+#include "key_map.hpp"
+#include "mapped_file.hpp"
+#include "numa.hpp"
+#include "profile.hpp"
+#include "scheduler.hpp"
+#include "snapshot.hpp"
+#include "tbl_scan.hpp"
+#include <iostream>
+#include <fstream>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Function to parse command line arguments
+bool parseArgs(int argc, char* argv[], std::string& r_name, std::string& start_date, std::string& end_date, int& num_threads, std::string& table_path, std::string& result_path, RunOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--pin_threads") options.pin_threads = true;
+        else if (arg == "--profile") options.profile = true;
+        else if (arg == "--stream") options.stream_lineitem = true;
+        else if (i + 1 < argc) { // Ensure there is a value after the flag
+            if (arg == "--r_name") r_name = argv[++i];
+            else if (arg == "--start_date") start_date = argv[++i];
+            else if (arg == "--end_date") end_date = argv[++i];
+            else if (arg == "--threads") num_threads = std::stoi(argv[++i]);
+            else if (arg == "--table_path") table_path = argv[++i];
+            else if (arg == "--result_path") result_path = argv[++i];
+            else if (arg == "--cache_dir") options.cache_dir = argv[++i];
+            else if (arg == "--batch") options.batch_file = argv[++i];
+            else if (arg == "--refresh") options.refresh_file = argv[++i];
+            else if (arg == "--numa" && !NumaPlacement::parseMode(argv[++i], options.numa)) {
+                std::cerr << "--numa must be local or interleave: " << argv[i] << std::endl;
+                return false;
+            } else if (arg == "--join") {
+                const std::string join = argv[++i];
+                if (join == "auto") options.plan.join = JoinStrategy::Auto;
+                else if (join == "hash") options.plan.join = JoinStrategy::Hash;
+                else if (join == "radix") options.plan.join = JoinStrategy::Radix;
+                else if (join == "merge") options.plan.join = JoinStrategy::Merge;
+                else {
+                    std::cerr << "--join must be auto, hash, radix or merge: " << join << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    
+    // Basic validation to ensure we got the necessary args; a batch supplies its own query parameters
+    const bool has_query = options.batch_file.empty() ? !(r_name.empty() || start_date.empty() || end_date.empty()) : true;
+    if (!has_query || table_path.empty() || result_path.empty() || num_threads <= 0) {
+        return false;
+    }
+    if (!options.batch_file.empty() && options.stream_lineitem) {
+        std::cerr << "--stream cannot be combined with --batch" << std::endl;
+        return false;
+    }
+    if (!options.refresh_file.empty() && options.stream_lineitem) {
+        std::cerr << "--stream cannot be combined with --refresh" << std::endl;
+        return false;
+    }
+    if (options.refresh_file == "-" && options.batch_file == "-") {
+        std::cerr << "--batch and --refresh cannot both read stdin" << std::endl;
+        return false;
+    }
+    if (options.batch_file.empty() && (!isValidDate(start_date) || !isValidDate(end_date))) {
+        std::cerr << "Dates must be valid YYYY-MM-DD dates: " << start_date << ", " << end_date << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool parseArgs(int argc, char* argv[], std::string& r_name, std::string& start_date, std::string& end_date, int& num_threads, std::string& table_path, std::string& result_path) {
+    RunOptions options;
+    return parseArgs(argc, argv, r_name, start_date, end_date, num_threads, table_path, result_path, options);
+}
+
+// Table schemas in .tbl field order
+const TableSchema CUSTOMER_SCHEMA = {"customer", {
+    {"c_custkey", ColumnType::Int32}, {"c_name", ColumnType::String}, {"c_address", ColumnType::String},
+    {"c_nationkey", ColumnType::Int32}, {"c_phone", ColumnType::String}, {"c_acctbal", ColumnType::Decimal},
+    {"c_mktsegment", ColumnType::String}, {"c_comment", ColumnType::String}}};
+const TableSchema ORDERS_SCHEMA = {"orders", {
+    {"o_orderkey", ColumnType::Int32}, {"o_custkey", ColumnType::Int32}, {"o_orderstatus", ColumnType::String},
+    {"o_totalprice", ColumnType::Decimal}, {"o_orderdate", ColumnType::Date}, {"o_orderpriority", ColumnType::String},
+    {"o_clerk", ColumnType::String}, {"o_shippriority", ColumnType::Int32}, {"o_comment", ColumnType::String}}};
+const TableSchema LINEITEM_SCHEMA = {"lineitem", {
+    {"l_orderkey", ColumnType::Int32}, {"l_partkey", ColumnType::Int32}, {"l_suppkey", ColumnType::Int32},
+    {"l_linenumber", ColumnType::Int32}, {"l_quantity", ColumnType::Decimal}, {"l_extendedprice", ColumnType::Decimal},
+    {"l_discount", ColumnType::Decimal}, {"l_tax", ColumnType::Decimal}, {"l_returnflag", ColumnType::String},
+    {"l_linestatus", ColumnType::String}, {"l_shipdate", ColumnType::Date}, {"l_commitdate", ColumnType::Date},
+    {"l_receiptdate", ColumnType::Date}, {"l_shipinstruct", ColumnType::String}, {"l_shipmode", ColumnType::String},
+    {"l_comment", ColumnType::String}}};
+const TableSchema SUPPLIER_SCHEMA = {"supplier", {
+    {"s_suppkey", ColumnType::Int32}, {"s_name", ColumnType::String}, {"s_address", ColumnType::String},
+    {"s_nationkey", ColumnType::Int32}, {"s_phone", ColumnType::String}, {"s_acctbal", ColumnType::Decimal},
+    {"s_comment", ColumnType::String}}};
+const TableSchema NATION_SCHEMA = {"nation", {
+    {"n_nationkey", ColumnType::Int32}, {"n_name", ColumnType::String}, {"n_regionkey", ColumnType::Int32},
+    {"n_comment", ColumnType::String}}};
+const TableSchema REGION_SCHEMA = {"region", {
+    {"r_regionkey", ColumnType::Int32}, {"r_name", ColumnType::String}, {"r_comment", ColumnType::String}}};
+
+const Column& ColumnTable::column(const std::string& name) const {
+    if (const Column* col = find(name)) return *col;
+    throw std::out_of_range("No column " + name + " in table " + (schema ? schema->name : std::string("?")));
+}
+
+const Column* ColumnTable::find(const std::string& name) const {
+    for (const auto& col : columns) {
+        if (col.name == name) return &col;
+    }
+    return nullptr;
+}
+
+bool isValidDate(const std::string& date) {
+    if (date.size() != 10 || date[4] != '-' || date[7] != '-') return false;
+    for (size_t i : {0, 1, 2, 3, 5, 6, 8, 9}) {
+        if (!isDigit(date[i])) return false;
+    }
+    const int y = std::stoi(date.substr(0, 4));
+    const int m = std::stoi(date.substr(5, 2));
+    const int d = std::stoi(date.substr(8, 2));
+    static const int days_in_month[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (m < 1 || m > 12 || d < 1) return false;
+    const bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    return d <= days_in_month[m - 1] + (m == 2 && leap);
+}
+
+int32_t dateToDayNumber(const std::string& date) {
+    int32_t day = 0;
+    if (!isValidDate(date) || !parseDate(date.data(), date.data() + date.size(), day)) {
+        throw std::invalid_argument("Bad date: " + date);
+    }
+    return day;
+}
+
+static_assert(DECIMAL_SCALE == 100, "Decimal columns are parsed with parseCents");
+
+// Columns referenced by executeQuery5; everything else is skipped at load time
+const std::vector<std::string> QUERY5_COLUMNS = {
+    "c_custkey", "c_nationkey",
+    "o_orderkey", "o_custkey", "o_orderdate",
+    "l_orderkey", "l_suppkey", "l_extendedprice", "l_discount",
+    "s_suppkey", "s_nationkey",
+    "n_nationkey", "n_name", "n_regionkey",
+    "r_regionkey", "r_name"};
+
+const std::vector<std::string> QUERY5_BUILD_COLUMNS = {
+    "c_custkey", "c_nationkey",
+    "o_orderkey", "o_custkey", "o_orderdate",
+    "s_suppkey", "s_nationkey",
+    "n_nationkey", "n_name", "n_regionkey",
+    "r_regionkey", "r_name"};
+
+// Value -> code map of a String column while loading. Keys point into the mapped file (or into the
+// chunk dictionaries while merging); nodes come from an Arena that lives as long as the map.
+using LoadDictionary = std::pmr::unordered_map<std::string_view, int32_t>;
+
+// Parses the '|' separated rows in [begin, end) and appends the projected fields to `table`.
+// field_index[c] is the file field stored in table.columns[c], in increasing order.
+static void parseRows(const char* begin, const char* end, const std::vector<size_t>& field_index,
+                      std::vector<LoadDictionary>& dictionaries, ColumnTable& table) {
+    const size_t num_cols = table.columns.size();
+    DelimiterScanner scanner(begin, end);
+    const char* p = begin;
+    while (p < end) {
+        size_t next_col = 0;
+        const char* field_begin = p;
+        const char* line_end;
+        for (size_t field = 0;; ++field) {
+            const char* delim = scanner.next(field_begin);
+            const bool last_in_line = delim == end || *delim == '\n';
+            const char* field_end = (last_in_line && delim > field_begin && delim[-1] == '\r') ? delim - 1 : delim;
+            if (field == field_index[next_col]) {
+                Column& col = table.columns[next_col];
+                switch (col.type) {
+                    case ColumnType::Int32:
+                        col.ints.push_back(parseInt32(field_begin, field_end));
+                        break;
+                    case ColumnType::Date: {
+                        int32_t day = 0;
+                        parseDate(field_begin, field_end, day);
+                        col.ints.push_back(day);
+                        break;
+                    }
+                    case ColumnType::Decimal:
+                        col.decimals.push_back(parseCents(field_begin, field_end));
+                        break;
+                    case ColumnType::String: {
+                        std::string_view value(field_begin, field_end - field_begin);
+                        auto inserted = dictionaries[next_col].emplace(value, static_cast<int32_t>(col.dictionary.size()));
+                        if (inserted.second) col.dictionary.emplace_back(value);
+                        col.ints.push_back(inserted.first->second);
+                        break;
+                    }
+                }
+                ++next_col;
+            }
+            if (last_in_line) {
+                line_end = delim;
+                break;
+            }
+            field_begin = delim + 1;
+            if (next_col == num_cols) {
+                // Everything after the last projected field is skipped without classifying '|'
+                line_end = scanner.nextNewline(field_begin);
+                break;
+            }
+        }
+
+        if (next_col == num_cols) {
+            ++table.num_rows;
+        } else {
+            // Short or empty line: drop the partially parsed row so every column keeps num_rows entries
+            for (size_t c = 0; c < next_col; ++c) {
+                Column& col = table.columns[c];
+                if (col.type == ColumnType::Decimal) col.decimals.pop_back();
+                else col.ints.pop_back();
+            }
+        }
+        p = line_end + 1;
+    }
+}
+
+// Size of the newline-aligned byte ranges a .tbl file is split into; each is one loader morsel
+const size_t LOAD_MORSEL_BYTES = 4 << 20;
+
+// One table being loaded: the mapped file cut into newline-aligned chunks, and the
+// per-chunk parse results that are concatenated into `table` once all chunks are done
+struct TableLoad {
+    std::unique_ptr<MappedFile> file;
+    ColumnTable* table = nullptr;
+    std::vector<size_t> field_index; // file field stored in table->columns[c]
+    std::vector<const char*> bounds; // chunk k is [bounds[k], bounds[k + 1])
+    std::vector<ColumnTable> chunks;
+    std::vector<std::vector<std::vector<int32_t>>> remaps; // [chunk][column] chunk code -> table code
+    std::vector<size_t> row_offsets;
+};
+
+// Field indexes of the schema columns named in `projection` (all of them if it is empty), in file order
+static std::vector<size_t> projectedFields(const TableSchema& schema, const std::vector<std::string>& projection) {
+    std::vector<size_t> fields;
+    for (size_t i = 0; i < schema.columns.size(); ++i) {
+        const std::string& name = schema.columns[i].name;
+        if (projection.empty() || std::find(projection.begin(), projection.end(), name) != projection.end()) {
+            fields.push_back(i);
+        }
+    }
+    return fields;
+}
+
+// Maps the file, sets up the projected columns and cuts the file into chunks
+static bool beginLoad(const std::string& filepath, const TableSchema& schema, const std::vector<std::string>& projection,
+                      ColumnTable& table, TableLoad& load) {
+    load.file.reset(new MappedFile(filepath));
+    if (!load.file->ok()) {
+        std::cerr << "Error opening file: " << filepath << std::endl;
+        return false;
+    }
+    const MappedFile& file = *load.file;
+
+    load.table = &table;
+    table.schema = &schema;
+    table.num_rows = 0;
+    table.columns.clear();
+    load.field_index = projectedFields(schema, projection);
+    for (size_t i : load.field_index) {
+        const ColumnDef& def = schema.columns[i];
+        table.columns.push_back(Column{def.name, def.type, {}, {}, {}, {}, {}, false});
+    }
+    if (load.field_index.empty()) return true;
+
+    // Chunk boundaries, each moved forward to the start of the next line
+    const size_t num_chunks = file.size() / LOAD_MORSEL_BYTES + 1;
+    load.bounds.assign(num_chunks + 1, file.end());
+    load.bounds[0] = file.begin();
+    for (size_t k = 1; k < num_chunks; ++k) {
+        const char* p = std::max(file.begin() + file.size() * k / num_chunks, load.bounds[k - 1]);
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', file.end() - p));
+        load.bounds[k] = nl ? nl + 1 : file.end();
+    }
+
+    load.chunks.resize(num_chunks);
+    for (ColumnTable& chunk : load.chunks) {
+        chunk.schema = &schema;
+        chunk.columns = table.columns;
+    }
+    return true;
+}
+
+// Chunks read ahead of the parser per worker; each is LOAD_MORSEL_BYTES
+const size_t PREFETCH_CHUNKS_PER_WORKER = 2;
+
+// Starts reading chunk k from disk in the background
+static void prefetchChunk(const TableLoad& load, size_t k) {
+    load.file->prefetch(load.bounds[k], load.bounds[k + 1]);
+}
+
+// The chunk's dictionary lookups are only needed while it is parsed, so their nodes are allocated
+// from an arena that is dropped as a whole afterwards instead of freed node by node
+static void parseChunk(TableLoad& load, size_t k) {
+    Arena arena;
+    std::vector<LoadDictionary> dictionaries;
+    for (size_t c = 0; c < load.chunks[k].columns.size(); ++c) dictionaries.emplace_back(&arena);
+    parseRows(load.bounds[k], load.bounds[k + 1], load.field_index, dictionaries, load.chunks[k]);
+}
+
+// Merges the chunk dictionaries in chunk order, so codes match a sequential load, and sizes the
+// table columns for the concatenation. A single chunk is moved into the table as is.
+// Returns false if the chunks were already moved and nothing is left to append.
+static bool mergeChunks(TableLoad& load) {
+    ColumnTable& table = *load.table;
+    const size_t num_chunks = load.chunks.size();
+    if (num_chunks == 0) return false;
+    if (num_chunks == 1) {
+        table.columns = std::move(load.chunks[0].columns);
+        table.num_rows = load.chunks[0].num_rows;
+        load.chunks.clear();
+        return false;
+    }
+
+    load.remaps.assign(num_chunks, std::vector<std::vector<int32_t>>(table.columns.size()));
+    for (size_t c = 0; c < table.columns.size(); ++c) {
+        Column& col = table.columns[c];
+        if (col.type != ColumnType::String) continue;
+        Arena arena;
+        LoadDictionary merged(&arena);
+        // Assign codes in first-occurrence order: chunk order, then code order within a chunk
+        for (size_t k = 0; k < num_chunks; ++k) {
+            const std::vector<std::string>& chunk_dict = load.chunks[k].columns[c].dictionary;
+            std::vector<int32_t>& remap = load.remaps[k][c];
+            remap.resize(chunk_dict.size());
+            for (size_t code = 0; code < chunk_dict.size(); ++code) {
+                auto inserted = merged.emplace(chunk_dict[code], static_cast<int32_t>(col.dictionary.size()));
+                if (inserted.second) col.dictionary.push_back(chunk_dict[code]);
+                remap[code] = inserted.first->second;
+            }
+        }
+    }
+
+    load.row_offsets.assign(num_chunks + 1, 0);
+    for (size_t k = 0; k < num_chunks; ++k) load.row_offsets[k + 1] = load.row_offsets[k] + load.chunks[k].num_rows;
+    table.num_rows = load.row_offsets[num_chunks];
+    for (Column& col : table.columns) {
+        if (col.type == ColumnType::Decimal) col.decimals.resize(table.num_rows);
+        else col.ints.resize(table.num_rows);
+    }
+    return true;
+}
+
+// Copies chunk k into its row range of the table, translating String codes, and frees the chunk
+static void appendChunk(TableLoad& load, size_t k) {
+    ColumnTable& chunk = load.chunks[k];
+    ColumnTable& table = *load.table;
+    const size_t row_offset = load.row_offsets[k];
+    for (size_t c = 0; c < table.columns.size(); ++c) {
+        const Column& src = chunk.columns[c];
+        Column& dst = table.columns[c];
+        if (dst.type == ColumnType::Decimal) {
+            std::copy(src.decimals.begin(), src.decimals.end(), dst.decimals.begin() + row_offset);
+        } else if (dst.type == ColumnType::String) {
+            const std::vector<int32_t>& codes = load.remaps[k][c];
+            auto out = dst.ints.begin() + row_offset;
+            for (int32_t code : src.ints) *out++ = codes[code];
+        } else {
+            std::copy(src.ints.begin(), src.ints.end(), dst.ints.begin() + row_offset);
+        }
+    }
+    chunk = ColumnTable();
+}
+
+// Runs the parse and concatenation steps of several table loads as one pool of morsels
+// (one chunk each), so small tables and the chunks of large ones are all loaded at once.
+static void runLoads(std::vector<TableLoad>& loads, int num_threads) {
+    std::vector<std::pair<size_t, size_t>> tasks; // (load, chunk)
+    for (size_t t = 0; t < loads.size(); ++t) {
+        for (size_t k = 0; k < loads[t].chunks.size(); ++k) tasks.emplace_back(t, k);
+    }
+    // Workers claim chunks in task order, so while task i is parsed the reads of the next
+    // prefetch_depth tasks are already in flight
+    const size_t prefetch_depth = PREFETCH_CHUNKS_PER_WORKER * std::max(num_threads, 1);
+    auto prefetch = [&](size_t i) {
+        if (i < tasks.size()) prefetchChunk(loads[tasks[i].first], tasks[i].second);
+    };
+    for (size_t i = 0; i < prefetch_depth; ++i) prefetch(i);
+    parallelForMorsels(num_threads, tasks.size(), 1, [&](int, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            prefetch(i + prefetch_depth);
+            parseChunk(loads[tasks[i].first], tasks[i].second);
+        }
+    });
+
+    tasks.clear();
+    for (size_t t = 0; t < loads.size(); ++t) {
+        if (!mergeChunks(loads[t])) continue;
+        for (size_t k = 0; k < loads[t].chunks.size(); ++k) tasks.emplace_back(t, k);
+    }
+    parallelForMorsels(num_threads, tasks.size(), 1, [&](int, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) appendChunk(loads[tasks[i].first], tasks[i].second);
+    });
+}
+
+// Computes the zone maps of the Date columns of `table` and the `sorted` flags of its Int32 and Date columns
+void buildZoneMaps(ColumnTable& table, int num_threads) {
+    const size_t num_zones = (table.num_rows + ZONE_ROWS - 1) / ZONE_ROWS;
+    for (Column& column : table.columns) {
+        if (column.type != ColumnType::Int32 && column.type != ColumnType::Date) continue;
+        std::atomic<bool> sorted{true};
+        parallelForMorsels(num_threads, table.num_rows, MORSEL_ROWS, [&](int, size_t begin, size_t end) {
+            for (size_t i = std::max<size_t>(begin, 1); i < end; ++i) {
+                if (column.ints[i] < column.ints[i - 1]) {
+                    sorted.store(false, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        });
+        column.sorted = sorted.load(std::memory_order_relaxed);
+        if (column.type != ColumnType::Date) continue;
+        column.zone_min.assign(num_zones, 0);
+        column.zone_max.assign(num_zones, 0);
+        parallelForMorsels(num_threads, num_zones, MORSEL_ROWS / ZONE_ROWS, [&](int, size_t begin, size_t end) {
+            for (size_t z = begin; z < end; ++z) {
+                const size_t row_end = std::min(table.num_rows, (z + 1) * ZONE_ROWS);
+                int32_t lo = INT32_MAX;
+                int32_t hi = INT32_MIN;
+                for (size_t i = z * ZONE_ROWS; i < row_end; ++i) {
+                    lo = std::min(lo, column.ints[i]);
+                    hi = std::max(hi, column.ints[i]);
+                }
+                column.zone_min[z] = lo;
+                column.zone_max[z] = hi;
+            }
+        });
+    }
+}
+
+// Helper function to read a single .tbl file into columnar storage.
+// Only the schema columns named in `projection` are parsed and stored (all of them if it is empty).
+// The file is memory-mapped and parsed in place, without per-field string copies. It is split into
+// newline-aligned chunks that num_threads workers parse as morsels into per-chunk columns, which are
+// then concatenated in file order, so the result is identical to a single-threaded load.
+bool loadTable(const std::string& filepath, const TableSchema& schema, const std::vector<std::string>& projection, ColumnTable& table, int num_threads) {
+    std::vector<TableLoad> loads(1);
+    if (!beginLoad(filepath, schema, projection, table, loads[0])) return false;
+    runLoads(loads, num_threads);
+    buildZoneMaps(table, num_threads);
+    return true;
+}
+
+// Moves each NUMA node's run of MORSEL_ROWS morsels of `table` to that node, matching the runs
+// parallelForNodeMorsels hands to the node's workers first
+static void distributeTable(ColumnTable& table) {
+    const NumaPlacement& numa = NumaPlacement::instance();
+    for (Column& column : table.columns) {
+        if (column.type == ColumnType::Decimal) {
+            numa.distribute(column.decimals.data(), column.decimals.size(), sizeof(int64_t), MORSEL_ROWS);
+        } else {
+            numa.distribute(column.ints.data(), column.ints.size(), sizeof(int32_t), MORSEL_ROWS);
+        }
+    }
+}
+
+// Function to read TPCH data from the specified paths.
+// All six tables are loaded together: their chunks form one set of morsels for num_threads workers.
+// With a cache_dir, each table is first looked up as a binary snapshot there; tables without a
+// current snapshot are parsed from .tbl and then written to the cache for the next run.
+// With --numa local, lineitem is then spread over the NUMA nodes for the probe.
+bool readTPCHData(const std::string& table_path,
+                  ColumnTable& customer_data,
+                  ColumnTable& orders_data,
+                  ColumnTable& lineitem_data,
+                  ColumnTable& supplier_data,
+                  ColumnTable& nation_data,
+                  ColumnTable& region_data,
+                  int num_threads,
+                  const std::vector<std::string>& projection,
+                  const std::string& cache_dir) {
+
+    // File names are the lowercase schema names, e.g. region.tbl
+    std::string path_suffix = (table_path.back() == '/' ? "" : "/");
+    auto tablePath = [&](const TableSchema& schema) { return table_path + path_suffix + schema.name + ".tbl"; };
+    auto snapshotPath = [&](const TableSchema& schema) { return cache_dir + "/" + schema.name + ".q5snap"; };
+    const bool use_cache = !cache_dir.empty();
+    if (use_cache) ::mkdir(cache_dir.c_str(), 0755);
+    ProfilePhase load_phase("load");
+
+    const std::vector<std::pair<const TableSchema*, ColumnTable*>> tables = {
+        {&CUSTOMER_SCHEMA, &customer_data}, {&ORDERS_SCHEMA, &orders_data}, {&LINEITEM_SCHEMA, &lineitem_data},
+        {&SUPPLIER_SCHEMA, &supplier_data}, {&NATION_SCHEMA, &nation_data}, {&REGION_SCHEMA, &region_data}};
+    std::vector<SourceStamp> stamps(tables.size());
+    std::vector<char> cached(tables.size(), 0);
+    if (use_cache) {
+        ProfilePhase phase("load_snapshots");
+        parallelForMorsels(num_threads, tables.size(), 1, [&](int, size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                const TableSchema& schema = *tables[t].first;
+                if (!statSource(tablePath(schema), stamps[t])) continue;
+                std::vector<std::string> columns;
+                for (size_t i : projectedFields(schema, projection)) columns.push_back(schema.columns[i].name);
+                cached[t] = readSnapshot(snapshotPath(schema), stamps[t], schema, columns, *tables[t].second);
+            }
+        });
+    }
+
+    std::vector<TableLoad> loads;
+    std::vector<size_t> parsed; // indexes into `tables` of the tables parsed from .tbl
+    for (size_t t = 0; t < tables.size(); ++t) {
+        if (cached[t]) continue;
+        loads.emplace_back();
+        parsed.push_back(t);
+        if (!beginLoad(tablePath(*tables[t].first), *tables[t].first, projection, *tables[t].second, loads.back())) return false;
+    }
+    {
+        ProfilePhase phase("parse_tbl");
+        runLoads(loads, num_threads);
+        size_t rows_parsed = 0;
+        for (size_t t : parsed) rows_parsed += tables[t].second->num_rows;
+        phase.setRowsOut(rows_parsed);
+    }
+
+    if (use_cache) {
+        ProfilePhase phase("write_snapshots");
+        parallelForMorsels(num_threads, parsed.size(), 1, [&](int, size_t begin, size_t end) {
+            for (size_t p = begin; p < end; ++p) {
+                const size_t t = parsed[p];
+                // A table with no projected columns (lineitem when it is streamed) is not worth caching
+                if (tables[t].second->columns.empty()) continue;
+                writeSnapshot(snapshotPath(*tables[t].first), stamps[t], *tables[t].second);
+            }
+        });
+    }
+
+    // Zone maps and sorted flags are cheap to recompute, so snapshots do not store them
+    {
+        ProfilePhase phase("zone_maps");
+        for (const auto& table : tables) buildZoneMaps(*table.second, num_threads);
+    }
+    if (NumaPlacement::instance().localNodes() > 1) {
+        ProfilePhase phase("numa_placement", lineitem_data.num_rows);
+        distributeTable(lineitem_data);
+    }
+    size_t rows_loaded = 0;
+    for (const auto& table : tables) rows_loaded += table.second->num_rows;
+    load_phase.setRowsOut(rows_loaded);
+    return true;
+}
+
+// Nation keys are small (25 in TPC-H), so join payloads carry them as int8_t
+using NationKey = int8_t;
+using NationMap = KeyMap<NationKey>;
+const NationKey NO_NATION = -1;
+const int32_t NATION_KEY_LIMIT = 128;
+
+// Size of a cache line, used to keep per-thread accumulators on lines of their own
+const size_t CACHE_LINE_BYTES = 64;
+
+// Build sides up to this size are assumed to stay in cache while lineitem is probed
+const size_t CACHE_RESIDENT_BYTES = 1 << 20;
+// Relative cost of a lookup into a build side that does not fit in cache
+const double PROBE_MISS_COST = 4.0;
+
+// Lineitems per batch of the hash probe: each step of probeRows runs over a whole batch before the
+// next one starts, and the batch's selection vectors stay in L1
+const size_t PROBE_BATCH_ROWS = 1024;
+
+// Under JoinStrategy::Auto, orders build sides larger than this (more than a typical last-level
+// cache, so that most direct probes would go to memory) are joined radix-partitioned
+const size_t RADIX_JOIN_MIN_BYTES = 32 << 20;
+// Share of the order map one radix partition covers; it stays in cache next to the other build sides
+const size_t RADIX_PARTITION_BYTES = CACHE_RESIDENT_BYTES / 2;
+// Most partition bits, so that the partition buffers one worker appends to stay within the TLB
+const int RADIX_MAX_BITS = 10;
+
+
+// Revenue accumulator of one query for one thread, indexed by nation key. Aligned (and so padded)
+// to whole cache lines so that no two threads ever write to the same line.
+struct alignas(CACHE_LINE_BYTES) NationSums {
+    Revenue revenue[NATION_KEY_LIMIT] = {};
+    uint64_t matches[NATION_KEY_LIMIT] = {};
+};
+
+// Build-side payload of a qualifying order: the nation of its customer, and one bit per query of
+// the current shared scan whose date range and region the order satisfies
+template <typename Mask>
+struct OrderMatch {
+    NationKey nation;
+    Mask queries;
+
+    bool operator==(const OrderMatch& other) const { return nation == other.nation && queries == other.queries; }
+    bool operator!=(const OrderMatch& other) const { return !(*this == other); }
+};
+
+// Runs filter(row, out) over rows [0, num_rows) as morsels. Each worker appends the build-side entries
+// it finds to its own vector, allocated from `resource`, and the per-worker vectors are handed to
+// KeyMap::build unmerged.
+template <typename Entry, typename Filter>
+static std::vector<std::pmr::vector<Entry>> collectEntries(int num_threads, size_t num_rows, std::pmr::memory_resource* resource,
+                                                           Filter filter) {
+    std::vector<std::pmr::vector<Entry>> per_worker;
+    for (int w = 0; w < num_threads; ++w) per_worker.emplace_back(resource);
+    parallelForMorsels(num_threads, num_rows, MORSEL_ROWS, [&](int worker_id, size_t begin, size_t end) {
+        std::pmr::vector<Entry>& out = per_worker[worker_id];
+        for (size_t i = begin; i < end; ++i) filter(i, out);
+    });
+    return per_worker;
+}
+
+// True if `table` has every column in `names`, each holding num_rows values; otherwise reports the
+// first that does not. Queries check their tables with this on the calling thread before any work
+// is dispatched, since ColumnTable::column() throws and pool tasks must not.
+static bool hasColumns(const ColumnTable& table, std::initializer_list<const char*> names) {
+    for (const char* name : names) {
+        const Column* col = table.find(name);
+        const size_t values = !col ? 0 : col->type == ColumnType::Decimal ? col->decimals.size() : col->ints.size();
+        if (!col || values != table.num_rows) {
+            std::cerr << "Table " << (table.schema ? table.schema->name : std::string("?")) << " lacks column " << name
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// The lineitem columns the probe reads, resolved before it is dispatched
+struct LineitemColumns {
+    const int32_t* l_orderkey = nullptr;
+    const int32_t* l_suppkey = nullptr;
+    const int64_t* l_extendedprice = nullptr;
+    const int64_t* l_discount = nullptr;
+    bool orderkey_sorted = false;
+};
+
+// Resolves the probe columns of `lineitem_data`; false, without reporting, if hasColumns() would fail
+static bool findLineitemColumns(const ColumnTable& lineitem_data, LineitemColumns& columns) {
+    const Column* l_orderkey = lineitem_data.find("l_orderkey");
+    const Column* l_suppkey = lineitem_data.find("l_suppkey");
+    const Column* l_extendedprice = lineitem_data.find("l_extendedprice");
+    const Column* l_discount = lineitem_data.find("l_discount");
+    const size_t rows = lineitem_data.num_rows;
+    if (!l_orderkey || !l_suppkey || !l_extendedprice || !l_discount || l_orderkey->ints.size() != rows ||
+        l_suppkey->ints.size() != rows || l_extendedprice->decimals.size() != rows || l_discount->decimals.size() != rows) {
+        return false;
+    }
+    columns = LineitemColumns{l_orderkey->ints.data(), l_suppkey->ints.data(), l_extendedprice->decimals.data(),
+                              l_discount->decimals.data(), l_orderkey->sorted};
+    return true;
+}
+
+// As findLineitemColumns, reporting a missing column
+static bool lineitemColumns(const ColumnTable& lineitem_data, LineitemColumns& columns) {
+    return hasColumns(lineitem_data, {"l_orderkey", "l_suppkey", "l_extendedprice", "l_discount"}) &&
+           findLineitemColumns(lineitem_data, columns);
+}
+
+// Executes up to 8 * sizeof(Mask) queries with one scan of each table. Every build-side row carries
+// a bitmask of the queries it qualifies for, so each lineitem is checked against all of them at once.
+// build() runs the filters and joins of everything but lineitem; probe() then takes lineitem in any
+// number of row ranges, from a loaded table or from chunks streamed off disk, and finish() collects
+// the revenue of query q into results[q]. lineitem_sorted tells build() whether lineitem comes in
+// l_orderkey order, which lets JoinStrategy::Auto pick a merge join; lineitem_streamed that it comes
+// as chunks off disk, which rules out a radix join. The sums accumulate over all
+// probes, and addOrders() extends the build side with appended orders, so a scan can be kept to
+// refresh its results as data arrives (see Query5Refresh).
+template <typename Mask>
+class SharedScan {
+public:
+    // A refreshable scan keeps its order side out of the arena, which frees nothing before the scan
+    // is destroyed, so that the arrays addOrders() grows or replaces are freed
+    explicit SharedScan(bool refreshable = false)
+        : order_resource_(refreshable ? std::pmr::get_default_resource() : &arena_) {}
+
+    bool build(const Query5Params* queries, size_t num_queries, int num_threads,
+               const ColumnTable& customer_data,
+               const ColumnTable& orders_data,
+               const ColumnTable& supplier_data,
+               const ColumnTable& nation_data,
+               const ColumnTable& region_data,
+               bool lineitem_sorted,
+               bool lineitem_streamed,
+               const QueryPlan& plan);
+
+    // Adds the qualifying orders of `orders_data`, rows appended after those given to build() and
+    // earlier addOrders() calls, to the build side. Call between probes, not during them, and on a
+    // refreshable scan, with orders_data checked by checkOrders().
+    void addOrders(const ColumnTable& orders_data, int num_threads);
+
+    // True if `orders_data` has the columns addOrders() reads, or no rows; reports what is missing
+    static bool checkOrders(const ColumnTable& orders_data) {
+        return orders_data.num_rows == 0 || hasColumns(orders_data, {"o_orderkey", "o_custkey", "o_orderdate"});
+    }
+
+    // Probes rows [begin, end) of the lineitem columns `lineitem`, adding to the partial sums of
+    // worker_id (or, for a radix join, to its partition buffers). Only reads shared state and writes
+    // state of worker_id, so workers with different ids may call it concurrently.
+    void probe(int worker_id, const LineitemColumns& lineitem, size_t begin, size_t end);
+
+    // Joins the rows buffered by a radix-partitioned probe, one partition per morsel, after the
+    // probe() calls of one pass over lineitem; later probes buffer into the emptied partitions.
+    // Does nothing for a hash join. finish() and matchedRows() count only joined rows.
+    void joinPartitions(int num_threads);
+
+    // Adds the revenue of query q to results[q]
+    void finish(std::map<std::string, Revenue>* results) const;
+
+    // Number of (lineitem, query) matches added up so far
+    uint64_t matchedRows() const;
+
+private:
+    using OrderMap = KeyMap<OrderMatch<Mask>>;
+
+    // The build-side structures read by the probe. A merge join uses merge_orders, the qualifying
+    // orders sorted by key, instead of valid_orders and order_filter.
+    struct ProbeSide {
+        explicit ProbeSide(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : valid_suppliers(resource), valid_orders(resource), order_filter(resource), merge_orders(resource) {}
+
+        NationMap valid_suppliers;
+        OrderMap valid_orders;
+        KeyFilter order_filter;
+        typename OrderMap::Entries merge_orders;
+    };
+
+    // A lineitem that passed the order filter and the supplier check, waiting for its order lookup
+    struct ProbeTuple {
+        int32_t orderkey;
+        NationKey s_nation;
+        Revenue revenue;
+    };
+
+    const ProbeSide& sideOf(int worker_id) const {
+        return sides_[NumaPlacement::instance().workerNode(worker_id) % sides_.size()];
+    }
+
+    // Build-side payload of an order placed by `custkey` on day `orderdate`; queries is 0 if it
+    // qualifies for none
+    OrderMatch<Mask> matchOrder(int32_t custkey, int32_t orderdate) const {
+        const uint32_t offset = static_cast<uint32_t>(orderdate) - static_cast<uint32_t>(first_day_);
+        if (offset >= date_queries_.size() || date_queries_[offset] == 0) return {NO_NATION, 0};
+        const NationKey c_nation = valid_customers_.find(custkey);
+        if (c_nation == NO_NATION) return {NO_NATION, 0};
+        return {c_nation, static_cast<Mask>(date_queries_[offset] & nation_queries_[c_nation])};
+    }
+
+    // Builds valid_orders and order_filter of sides_[0] from order_entries_
+    void buildOrderMap(int num_threads);
+
+    // Chooses the check order, probe kernel and radix partitioning for the current build side
+    void prepareProbe(int num_threads);
+
+    // Makes the NUMA copies of sides_[0], replacing any earlier ones
+    void copySides(int num_threads);
+
+    static void addRevenue(std::vector<NationSums>& partial, Mask queries, NationKey nation, Revenue revenue) {
+        for (Mask m = queries; m != 0; m &= static_cast<Mask>(m - 1)) {
+            NationSums& sums = partial[__builtin_ctzll(m)];
+            sums.revenue[nation] += revenue;
+            ++sums.matches[nation];
+        }
+    }
+
+    template <bool SUPPLIER_FIRST>
+    void partitionRows(const ProbeSide& side, std::vector<std::vector<ProbeTuple>>& partitions, const int32_t* l_orderkey,
+                       const int32_t* l_suppkey, const int64_t* l_extendedprice, const int64_t* l_discount,
+                       size_t begin, size_t end) const;
+
+    template <bool SUPPLIER_FIRST, bool DIRECT_ORDERS, bool BITMAP_FILTER>
+    void probeRows(const ProbeSide& side, std::vector<NationSums>& partial, const int32_t* l_orderkey, const int32_t* l_suppkey,
+                   const int64_t* l_extendedprice, const int64_t* l_discount, size_t begin, size_t end) const;
+
+    using ProbeKernel = void (SharedScan::*)(const ProbeSide&, std::vector<NationSums>&, const int32_t*, const int32_t*,
+                                             const int64_t*, const int64_t*, size_t, size_t) const;
+
+    // The probeRows instantiation for a join order and the layouts of the order map and filter
+    static ProbeKernel probeKernel(bool supplier_first, bool direct_orders, bool bitmap_filter) {
+        static const ProbeKernel kernels[2][2][2] = {
+            {{&SharedScan::probeRows<false, false, false>, &SharedScan::probeRows<false, false, true>},
+             {&SharedScan::probeRows<false, true, false>, &SharedScan::probeRows<false, true, true>}},
+            {{&SharedScan::probeRows<true, false, false>, &SharedScan::probeRows<true, false, true>},
+             {&SharedScan::probeRows<true, true, false>, &SharedScan::probeRows<true, true, true>}}};
+        return kernels[supplier_first][direct_orders][bitmap_filter];
+    }
+
+    void mergeRows(const ProbeSide& side, std::vector<NationSums>& partial, const int32_t* l_orderkey, const int32_t* l_suppkey,
+                   const int64_t* l_extendedprice, const int64_t* l_discount, size_t begin, size_t end) const;
+
+    // Holds the build side, but for a refreshable scan's order side, and its temporary entry lists;
+    // declared first so it is released last, in one step, when the scan is destroyed
+    Arena arena_;
+    size_t num_queries_ = 0;
+    const Column* n_name_col_ = nullptr;
+    std::vector<int32_t> nation_key_to_name_;
+    // What addOrders() needs of the other tables: customers of the queries' nations, the queries
+    // of each nation, and the queries of each order date from first_day_ on
+    NationMap valid_customers_{&arena_};
+    std::vector<Mask> nation_queries_;
+    std::vector<Mask> date_queries_;
+    int32_t first_day_ = INT32_MAX;
+    // Qualifying orders per build worker, kept to rebuild the hash join's order map when addOrders()
+    // outgrows it
+    std::vector<typename OrderMap::Entries> order_entries_;
+    std::pmr::memory_resource* order_resource_; // of sides_ and order_entries_
+    size_t order_rows_ = 0;    // orders filtered so far
+    size_t supplier_rows_ = 0; // rows of the supplier table
+    // sides_[node] is probed by the workers of NUMA node `node`: with --numa local every node in use
+    // gets its own copy, so the probe's random lookups stay node-local
+    std::vector<ProbeSide> sides_;
+    bool supplier_first_ = false;
+    ProbeKernel probe_kernel_ = nullptr; // hash join probe, chosen once the build side is built
+    bool merge_ = false; // merge join against side.merge_orders
+    bool streamed_ = false; // lineitem arrives as chunks streamed off disk
+    QueryPlan plan_;        // as given to build(), also for addOrders()
+    // Radix join: a lineitem goes to partition position(l_orderkey) >> radix_shift_ of the order map,
+    // so each partition's lookups fall into one 1 / num_partitions_ slice of the map's array.
+    // num_partitions_ is 0 for a hash join.
+    size_t num_partitions_ = 0;
+    int radix_shift_ = 0;
+    std::vector<std::vector<std::vector<ProbeTuple>>> partitions_; // [worker][partition]
+    // Per-thread partial sums, one NationSums per query, allocated before any worker starts
+    std::vector<std::vector<NationSums>> thread_results_;
+};
+
+template <typename Mask>
+bool SharedScan<Mask>::build(const Query5Params* queries, size_t num_queries, int num_threads,
+                             const ColumnTable& customer_data,
+                             const ColumnTable& orders_data,
+                             const ColumnTable& supplier_data,
+                             const ColumnTable& nation_data,
+                             const ColumnTable& region_data,
+                             bool lineitem_sorted,
+                             bool lineitem_streamed,
+                             const QueryPlan& plan) {
+    num_queries_ = num_queries;
+    streamed_ = lineitem_streamed;
+    plan_ = plan;
+    if (num_queries > 8 * sizeof(Mask)) return false;
+    if (!hasColumns(region_data, {"r_regionkey", "r_name"}) ||
+        !hasColumns(nation_data, {"n_nationkey", "n_name", "n_regionkey"}) ||
+        !hasColumns(customer_data, {"c_custkey", "c_nationkey"}) ||
+        !hasColumns(supplier_data, {"s_suppkey", "s_nationkey"}) ||
+        !hasColumns(orders_data, {"o_orderkey", "o_custkey", "o_orderdate"})) {
+        return false;
+    }
+    sides_.clear();
+    sides_.emplace_back(order_resource_);
+    ProbeSide& side = sides_[0];
+    for (size_t q = 0; q < num_queries; ++q) {
+        if (!isValidDate(queries[q].start_date) || !isValidDate(queries[q].end_date)) {
+            std::cerr << "Invalid date range: " << queries[q].start_date << ", " << queries[q].end_date << std::endl;
+            return false;
+        }
+    }
+
+    // 1. Filter Regions (Find Region Keys for each query's r_name, e.g., 'ASIA')
+    ProfilePhase nations_phase("region_nation_filter", region_data.num_rows + nation_data.num_rows);
+    const Column& r_name_col = region_data.column("r_name");
+    const auto& r_regionkey = region_data.column("r_regionkey").ints;
+    std::vector<std::vector<int32_t>> valid_region_keys(num_queries);
+    for (size_t q = 0; q < num_queries; ++q) {
+        for (size_t i = 0; i < region_data.num_rows; ++i) {
+            if (r_name_col.dictionary[r_name_col.ints[i]] == queries[q].r_name) {
+                valid_region_keys[q].push_back(r_regionkey[i]);
+            }
+        }
+    }
+
+    // 2. Filter Nations (Find Nations in those Regions)
+    // Map Key -> queries whose region contains the nation, and Key -> code of its name in n_name
+    n_name_col_ = &nation_data.column("n_name");
+    const auto& n_nationkey = nation_data.column("n_nationkey").ints;
+    const auto& n_regionkey = nation_data.column("n_regionkey").ints;
+    nation_queries_.assign(NATION_KEY_LIMIT, 0);
+    nation_key_to_name_.assign(NATION_KEY_LIMIT, -1);
+    for (size_t i = 0; i < nation_data.num_rows; ++i) {
+        if (n_nationkey[i] < 0 || n_nationkey[i] >= NATION_KEY_LIMIT) {
+            std::cerr << "Nation key out of range: " << n_nationkey[i] << std::endl;
+            return false;
+        }
+        nation_key_to_name_[n_nationkey[i]] = n_name_col_->ints[i];
+        for (size_t q = 0; q < num_queries; ++q) {
+            for (int32_t r_key : valid_region_keys[q]) {
+                if (n_regionkey[i] == r_key) nation_queries_[n_nationkey[i]] |= static_cast<Mask>(Mask(1) << q);
+            }
+        }
+    }
+    auto isValidNation = [&](int32_t n_key) {
+        return n_key >= 0 && n_key < NATION_KEY_LIMIT && nation_queries_[n_key] != 0;
+    };
+    nations_phase.finish(std::count_if(nation_queries_.begin(), nation_queries_.end(), [](Mask m) { return m != 0; }));
+
+    // 3. Filter Customers (Find Customers in those Nations)
+    ProfilePhase customers_phase("customer_filter", customer_data.num_rows);
+    // Map CustKey -> NationKey (Only for nations of at least one query)
+    const auto& c_custkey = customer_data.column("c_custkey").ints;
+    const auto& c_nationkey = customer_data.column("c_nationkey").ints;
+    std::vector<NationMap::Entries> entries = collectEntries<NationMap::Entry>(num_threads, customer_data.num_rows, &arena_,
+        [&](size_t i, NationMap::Entries& out) {
+            if (isValidNation(c_nationkey[i])) {
+                out.emplace_back(c_custkey[i], static_cast<NationKey>(c_nationkey[i]));
+            }
+        });
+    valid_customers_.build(entries, NO_NATION, num_threads);
+    customers_phase.finish(valid_customers_.size());
+
+    // 4. Filter Suppliers (Find Suppliers in those Nations)
+    ProfilePhase suppliers_phase("supplier_filter", supplier_data.num_rows);
+    // Map SuppKey -> NationKey
+    const auto& s_suppkey = supplier_data.column("s_suppkey").ints;
+    const auto& s_nationkey = supplier_data.column("s_nationkey").ints;
+    entries = collectEntries<NationMap::Entry>(num_threads, supplier_data.num_rows, &arena_,
+        [&](size_t i, NationMap::Entries& out) {
+            if (isValidNation(s_nationkey[i])) {
+                out.emplace_back(s_suppkey[i], static_cast<NationKey>(s_nationkey[i]));
+            }
+        });
+    side.valid_suppliers.build(entries, NO_NATION, num_threads);
+    supplier_rows_ = supplier_data.num_rows;
+    suppliers_phase.finish(side.valid_suppliers.size());
+    entries.clear();
+
+    // 5. Filter Orders (Match valid Customers and Date Range)
+    ProfilePhase orders_phase("orders_filter", orders_data.num_rows);
+    // Map OrderKey -> nation of the ordering customer and the queries the order qualifies for.
+    // date_queries_[d - first_day_] holds the queries whose [start_date, end_date) contains day d.
+    std::vector<int32_t> start_day(num_queries), end_day(num_queries);
+    int32_t first_day = INT32_MAX;
+    int32_t last_day = INT32_MIN;
+    for (size_t q = 0; q < num_queries; ++q) {
+        start_day[q] = dateToDayNumber(queries[q].start_date);
+        end_day[q] = dateToDayNumber(queries[q].end_date);
+        if (start_day[q] < end_day[q]) {
+            first_day = std::min(first_day, start_day[q]);
+            last_day = std::max(last_day, end_day[q]);
+        }
+    }
+    first_day_ = first_day;
+    date_queries_.assign(first_day < last_day ? static_cast<size_t>(last_day - first_day) : 0, 0);
+    for (size_t q = 0; q < num_queries; ++q) {
+        for (int32_t day = start_day[q]; day < end_day[q]; ++day) {
+            date_queries_[day - first_day] |= static_cast<Mask>(Mask(1) << q);
+        }
+    }
+
+    const auto& o_orderkey = orders_data.column("o_orderkey").ints;
+    const auto& o_custkey = orders_data.column("o_custkey").ints;
+    const Column& o_orderdate_col = orders_data.column("o_orderdate");
+    const auto& o_orderdate = o_orderdate_col.ints;
+    const size_t num_zones = (orders_data.num_rows + ZONE_ROWS - 1) / ZONE_ROWS;
+    const bool has_zones = o_orderdate_col.zone_min.size() == num_zones;
+    // A zone is scanned only if its [min, max] date range overlaps some query's date range
+    auto zoneMayMatch = [&](size_t z) {
+        if (!has_zones) return true;
+        for (size_t q = 0; q < num_queries; ++q) {
+            if (o_orderdate_col.zone_max[z] >= start_day[q] && o_orderdate_col.zone_min[z] < end_day[q]) return true;
+        }
+        return false;
+    };
+    // A merge join needs no hash table: when both tables are sorted by order key, qualifying orders
+    // are met in key order, as lineitems are
+    const Column& o_orderkey_col = orders_data.column("o_orderkey");
+    merge_ = plan_.join == JoinStrategy::Merge || (plan_.join == JoinStrategy::Auto && lineitem_sorted && o_orderkey_col.sorted);
+    // spans[m]: where morsel m's entries are in order_entries_, so a merge join can concatenate them in table order
+    struct Span {
+        int worker;
+        size_t begin;
+        size_t end;
+    };
+    const size_t zones_per_morsel = MORSEL_ROWS / ZONE_ROWS;
+    std::vector<Span> spans(merge_ ? (num_zones + zones_per_morsel - 1) / zones_per_morsel : 0, Span{0, 0, 0});
+    order_entries_.clear();
+    for (int w = 0; w < num_threads; ++w) order_entries_.emplace_back(order_resource_);
+    parallelForMorsels(num_threads, num_zones, zones_per_morsel, [&](int worker_id, size_t begin, size_t end) {
+        typename OrderMap::Entries& out = order_entries_[worker_id];
+        const size_t span_begin = out.size();
+        for (size_t z = begin; z < end; ++z) {
+            if (!zoneMayMatch(z)) continue;
+            const size_t row_end = std::min(orders_data.num_rows, (z + 1) * ZONE_ROWS);
+            for (size_t i = z * ZONE_ROWS; i < row_end; ++i) {
+                // Check date range and if customer is valid, for all queries at once
+                const OrderMatch<Mask> match = matchOrder(o_custkey[i], o_orderdate[i]);
+                if (match.queries != 0) out.emplace_back(o_orderkey[i], match);
+            }
+        }
+        if (merge_) spans[begin / zones_per_morsel] = Span{worker_id, span_begin, out.size()};
+    });
+    if (merge_) {
+        std::vector<size_t> offsets(spans.size() + 1, 0);
+        for (size_t m = 0; m < spans.size(); ++m) offsets[m + 1] = offsets[m] + (spans[m].end - spans[m].begin);
+        side.merge_orders.resize(offsets.back());
+        parallelForMorsels(num_threads, spans.size(), 1, [&](int, size_t begin, size_t end) {
+            for (size_t m = begin; m < end; ++m) {
+                const auto& part = order_entries_[spans[m].worker];
+                std::copy(part.begin() + spans[m].begin, part.begin() + spans[m].end, side.merge_orders.begin() + offsets[m]);
+            }
+        });
+        // Only a forced merge join over unsorted orders has to sort
+        auto byKey = [](const typename OrderMap::Entry& a, const typename OrderMap::Entry& b) { return a.first < b.first; };
+        if (!std::is_sorted(side.merge_orders.begin(), side.merge_orders.end(), byKey)) {
+            std::sort(side.merge_orders.begin(), side.merge_orders.end(), byKey);
+        }
+        order_entries_.clear();
+        orders_phase.finish(side.merge_orders.size());
+    } else {
+        buildOrderMap(num_threads);
+        orders_phase.finish(side.valid_orders.size());
+    }
+    order_rows_ = orders_data.num_rows;
+
+    prepareProbe(num_threads);
+    copySides(num_threads);
+    thread_results_.assign(num_threads, std::vector<NationSums>(num_queries));
+    return true;
+}
+
+template <typename Mask>
+void SharedScan<Mask>::buildOrderMap(int num_threads) {
+    ProbeSide& side = sides_[0];
+    const OrderMatch<Mask> no_match = {NO_NATION, 0};
+    const KernelChoice direct_orders = plan_.probe_kernel.direct_orders;
+    const KernelChoice bitmap_filter = plan_.probe_kernel.bitmap_filter;
+    side.valid_orders.build(order_entries_, no_match, num_threads,
+                            direct_orders == KernelChoice::Auto ? MapLayout::Auto
+                            : direct_orders == KernelChoice::On ? MapLayout::Direct : MapLayout::Hash);
+    // Semi-join filter of the qualifying order keys, small enough to stay in cache during the probe
+    side.order_filter.build(order_entries_, num_threads,
+                            bitmap_filter == KernelChoice::Auto ? FilterLayout::Auto
+                            : bitmap_filter == KernelChoice::On ? FilterLayout::Bitmap : FilterLayout::Bloom);
+}
+
+template <typename Mask>
+void SharedScan<Mask>::prepareProbe(int num_threads) {
+    const ProbeSide& side = sides_[0];
+
+    // Order the lineitem-side checks by expected cost per row. A check costs one unit if its build
+    // side fits in cache and PROBE_MISS_COST units otherwise; its pass rate is the fraction of its
+    // build table kept (lineitems spread evenly over orders and suppliers).
+    auto probeCost = [](size_t bytes) { return bytes <= CACHE_RESIDENT_BYTES ? 1.0 : PROBE_MISS_COST; };
+    const double filter_cost = probeCost(side.order_filter.sizeBytes());
+    const double order_cost = probeCost(side.valid_orders.sizeBytes());
+    const double supplier_cost = probeCost(side.valid_suppliers.sizeBytes());
+    const double order_pass = static_cast<double>(side.valid_orders.size()) / std::max<size_t>(order_rows_, 1);
+    const double supplier_pass = static_cast<double>(side.valid_suppliers.size()) / std::max<size_t>(supplier_rows_, 1);
+    supplier_first_ = plan_.probe_kernel.supplier_first == KernelChoice::Auto
+                          ? supplier_cost + supplier_pass * (filter_cost + order_pass * order_cost) <
+                                filter_cost + order_pass * (order_cost + supplier_cost)
+                          : plan_.probe_kernel.supplier_first == KernelChoice::On;
+    // Every NUMA copy of the side has its layouts, so one kernel serves all workers
+    probe_kernel_ = probeKernel(supplier_first_, side.valid_orders.isDirect(), side.order_filter.isBitmap());
+
+    // A radix join buffers the lineitems that pass the cheap checks and looks their orders up
+    // partition by partition, trading one write and read of each buffered row for cache misses
+    const size_t order_bytes = side.valid_orders.sizeBytes();
+    num_partitions_ = 0;
+    partitions_.clear();
+    if (merge_) {
+        // Neither check order nor partitioning applies: the merge cursor moves forward anyway
+    } else if (streamed_) {
+        // The partitions would hold every surviving lineitem until the stream ends, which a stream
+        // must not; a forced radix join falls back to hash
+    } else if (plan_.join == JoinStrategy::Radix || (plan_.join == JoinStrategy::Auto && order_bytes > RADIX_JOIN_MIN_BYTES)) {
+        int bits = 0;
+        while (bits < RADIX_MAX_BITS && (order_bytes >> bits) > RADIX_PARTITION_BYTES) ++bits;
+        int capacity_bits = 0;
+        while ((size_t(1) << capacity_bits) < side.valid_orders.capacity()) ++capacity_bits;
+        radix_shift_ = std::max(capacity_bits - bits, 0);
+        num_partitions_ = size_t(1) << bits;
+        partitions_.assign(num_threads, std::vector<std::vector<ProbeTuple>>(num_partitions_));
+    }
+}
+
+template <typename Mask>
+void SharedScan<Mask>::copySides(int num_threads) {
+    sides_.resize(1);
+    // Each copy is made by a worker running on its node, so first touch places it there
+    const int num_nodes = std::min(NumaPlacement::instance().localNodes(), std::max(num_threads, 1));
+    if (num_nodes > 1) {
+        sides_.resize(num_nodes);
+        ThreadPool::instance().run(num_nodes, [&](int worker_id) {
+            if (worker_id > 0) sides_[worker_id] = sides_[0];
+        });
+    }
+}
+
+// Appended orders join the build side as new entries: appended to the sorted orders of a merge
+// join, or inserted into the hash join's order map and filter where their layout has room, which
+// costs the size of the delta. A map or filter without room is rebuilt from the entry lists; a
+// rebuilt hash table or Bloom filter at least doubles, so rebuilds are amortized over the deltas.
+// Every NUMA copy takes the new entries itself, on a worker of its node.
+template <typename Mask>
+void SharedScan<Mask>::addOrders(const ColumnTable& orders_data, int num_threads) {
+    if (orders_data.num_rows == 0) return;
+    ProfilePhase phase("orders_refresh", orders_data.num_rows);
+    const auto& o_orderkey = orders_data.column("o_orderkey").ints;
+    const auto& o_custkey = orders_data.column("o_custkey").ints;
+    const auto& o_orderdate = orders_data.column("o_orderdate").ints;
+    std::vector<typename OrderMap::Entries> added = collectEntries<typename OrderMap::Entry>(
+        num_threads, orders_data.num_rows, std::pmr::get_default_resource(), [&](size_t i, typename OrderMap::Entries& out) {
+            const OrderMatch<Mask> match = matchOrder(o_custkey[i], o_orderdate[i]);
+            if (match.queries != 0) out.emplace_back(o_orderkey[i], match);
+        });
+    order_rows_ += orders_data.num_rows;
+    size_t num_added = 0;
+    for (const auto& part : added) num_added += part.size();
+    if (merge_) {
+        auto byKey = [](const typename OrderMap::Entry& a, const typename OrderMap::Entry& b) { return a.first < b.first; };
+        ThreadPool::instance().run(static_cast<int>(sides_.size()), [&](int worker_id) {
+            auto& orders = sides_[worker_id].merge_orders;
+            const size_t old_size = orders.size();
+            for (const auto& part : added) orders.insert(orders.end(), part.begin(), part.end());
+            // New keys usually follow the old ones, so only the new tail is sorted and then merged
+            std::sort(orders.begin() + old_size, orders.end(), byKey);
+            if (old_size > 0 && orders.size() > old_size && byKey(orders[old_size], orders[old_size - 1])) {
+                std::inplace_merge(orders.begin(), orders.begin() + old_size, orders.end(), byKey);
+            }
+        });
+        prepareProbe(num_threads);
+    } else {
+        for (size_t w = 0; w < added.size(); ++w) {
+            auto& entries = order_entries_[w % order_entries_.size()];
+            entries.insert(entries.end(), added[w].begin(), added[w].end());
+        }
+        // The copies share the layouts of sides_[0], so they have room exactly when it has
+        std::vector<char> inserted(sides_.size(), 0);
+        ThreadPool::instance().run(static_cast<int>(sides_.size()), [&](int worker_id) {
+            ProbeSide& side = sides_[worker_id];
+            inserted[worker_id] = side.valid_orders.insert(added) && side.order_filter.insert(added);
+        });
+        if (inserted[0]) {
+            prepareProbe(num_threads);
+        } else {
+            buildOrderMap(num_threads);
+            prepareProbe(num_threads);
+            copySides(num_threads);
+        }
+    }
+    phase.setRowsOut(num_added);
+}
+
+// 6. Process Lineitems (The heavy lifting - Multithreaded)
+template <typename Mask>
+void SharedScan<Mask>::probe(int worker_id, const LineitemColumns& lineitem, size_t begin, size_t end) {
+    const int32_t* l_orderkey = lineitem.l_orderkey;
+    const int32_t* l_suppkey = lineitem.l_suppkey;
+    const int64_t* l_extendedprice = lineitem.l_extendedprice;
+    const int64_t* l_discount = lineitem.l_discount;
+    const ProbeSide& side = sideOf(worker_id);
+    if (merge_) {
+        mergeRows(side, thread_results_[worker_id], l_orderkey, l_suppkey, l_extendedprice, l_discount, begin, end);
+    } else if (num_partitions_ > 0) {
+        if (supplier_first_) {
+            partitionRows<true>(side, partitions_[worker_id], l_orderkey, l_suppkey, l_extendedprice, l_discount, begin, end);
+        } else {
+            partitionRows<false>(side, partitions_[worker_id], l_orderkey, l_suppkey, l_extendedprice, l_discount, begin, end);
+        }
+    } else {
+        (this->*probe_kernel_)(side, thread_results_[worker_id], l_orderkey, l_suppkey, l_extendedprice, l_discount, begin, end);
+    }
+}
+
+// The probe only reads shared state: build-side maps are immutable once built and each
+// worker writes nothing but its own NationSums, so no locking or allocation is needed.
+// Rows go through in batches of PROBE_BATCH_ROWS. The filters first reduce a batch to a selection
+// vector, appending every row but advancing only past those that pass, so no step branches on a
+// row. The lookups of the survivors are then prefetched together and done in a second pass, and
+// only the rows that join have their revenue computed and added.
+// DIRECT_ORDERS and BITMAP_FILTER are the layouts of side.valid_orders and side.order_filter.
+template <typename Mask>
+template <bool SUPPLIER_FIRST, bool DIRECT_ORDERS, bool BITMAP_FILTER>
+void SharedScan<Mask>::probeRows(const ProbeSide& side, std::vector<NationSums>& partial, const int32_t* l_orderkey, const int32_t* l_suppkey,
+                                 const int64_t* l_extendedprice, const int64_t* l_discount, size_t begin, size_t end) const {
+    uint32_t selected[PROBE_BATCH_ROWS]; // batch offsets of the rows still in play
+    NationKey s_nations[PROBE_BATCH_ROWS];
+    Mask matching[PROBE_BATCH_ROWS];
+    Revenue revenue[PROBE_BATCH_ROWS];
+    for (size_t batch = begin; batch < end; batch += PROBE_BATCH_ROWS) {
+        const int32_t* orderkeys = l_orderkey + batch;
+        const int32_t* suppkeys = l_suppkey + batch;
+        const uint32_t batch_rows = static_cast<uint32_t>(std::min(PROBE_BATCH_ROWS, end - batch));
+        size_t count = 0;
+        if (SUPPLIER_FIRST) {
+            // Rejects lineitems whose supplier is outside the region of every query
+            for (uint32_t r = 0; r < batch_rows; ++r) {
+                selected[count] = r;
+                s_nations[count] = side.valid_suppliers.find(suppkeys[r]);
+                count += s_nations[count] != NO_NATION;
+            }
+            size_t kept = 0;
+            for (size_t k = 0; k < count; ++k) {
+                selected[kept] = selected[k];
+                s_nations[kept] = s_nations[k];
+                kept += side.order_filter.template mayContainAs<BITMAP_FILTER>(orderkeys[selected[k]]);
+            }
+            count = kept;
+        } else {
+            // Most lineitems belong to no qualifying order and are rejected by one bit test here
+            for (uint32_t r = 0; r < batch_rows; ++r) {
+                selected[count] = r;
+                count += side.order_filter.template mayContainAs<BITMAP_FILTER>(orderkeys[r]);
+            }
+        }
+
+        for (size_t k = 0; k < count; ++k) {
+            side.valid_orders.template prefetchAs<DIRECT_ORDERS>(orderkeys[selected[k]]);
+            if (!SUPPLIER_FIRST) side.valid_suppliers.prefetch(suppkeys[selected[k]]);
+        }
+
+        // Check if the order is valid for any query; its payload carries the customer's nation.
+        // Condition: c_nationkey = s_nationkey. The customer's nation is in the region of every
+        // query in order.queries, so the supplier's is too.
+        size_t joined = 0;
+        for (size_t k = 0; k < count; ++k) {
+            const uint32_t r = selected[k];
+            const OrderMatch<Mask> order = side.valid_orders.template findAs<DIRECT_ORDERS>(orderkeys[r]);
+            const NationKey s_nation = SUPPLIER_FIRST ? s_nations[k] : side.valid_suppliers.find(suppkeys[r]);
+            selected[joined] = r;
+            s_nations[joined] = s_nation;
+            matching[joined] = order.queries;
+            joined += order.queries != 0 && s_nation == order.nation;
+        }
+
+        // Exact in fixed point: cents * (DECIMAL_SCALE - discount cents) is scaled by REVENUE_SCALE
+        const int64_t* prices = l_extendedprice + batch;
+        const int64_t* discounts = l_discount + batch;
+        for (size_t k = 0; k < joined; ++k) revenue[k] = prices[selected[k]] * (DECIMAL_SCALE - discounts[selected[k]]);
+        for (size_t k = 0; k < joined; ++k) addRevenue(partial, matching[k], s_nations[k], revenue[k]);
+    }
+}
+
+// Merge join of a lineitem range with the qualifying orders: a cursor moves forward through
+// merge_orders as l_orderkey grows, so both are read sequentially. The cursor is placed by binary
+// search at the start of the range and wherever l_orderkey decreases, so rows out of key order
+// are slower but still joined exactly.
+template <typename Mask>
+void SharedScan<Mask>::mergeRows(const ProbeSide& side, std::vector<NationSums>& partial, const int32_t* l_orderkey,
+                                 const int32_t* l_suppkey, const int64_t* l_extendedprice, const int64_t* l_discount,
+                                 size_t begin, size_t end) const {
+    using Entry = typename OrderMap::Entry;
+    const Entry* orders_begin = side.merge_orders.data();
+    const Entry* orders_end = orders_begin + side.merge_orders.size();
+    auto keyLess = [](const Entry& e, int32_t key) { return e.first < key; };
+    const Entry* cursor = orders_begin;
+    int32_t previous_key = INT32_MAX; // makes the first row search
+    for (size_t i = begin; i < end; ++i) {
+        const int32_t key = l_orderkey[i];
+        if (key < previous_key) {
+            cursor = std::lower_bound(orders_begin, orders_end, key, keyLess);
+        } else {
+            while (cursor != orders_end && cursor->first < key) ++cursor;
+        }
+        previous_key = key;
+        if (cursor == orders_end || cursor->first != key) continue;
+        const NationKey s_nation = side.valid_suppliers.find(l_suppkey[i]);
+        if (s_nation != cursor->second.nation) continue;
+        addRevenue(partial, cursor->second.queries, s_nation, l_extendedprice[i] * (DECIMAL_SCALE - l_discount[i]));
+    }
+}
+
+// First half of a radix join: the checks that need no order lookup, then one append to the
+// partition of the order map slice the lookup will read
+template <typename Mask>
+template <bool SUPPLIER_FIRST>
+void SharedScan<Mask>::partitionRows(const ProbeSide& side, std::vector<std::vector<ProbeTuple>>& partitions,
+                                     const int32_t* l_orderkey, const int32_t* l_suppkey, const int64_t* l_extendedprice,
+                                     const int64_t* l_discount, size_t begin, size_t end) const {
+    for (size_t i = begin; i < end; ++i) {
+        NationKey s_nation = NO_NATION;
+        if (SUPPLIER_FIRST) {
+            s_nation = side.valid_suppliers.find(l_suppkey[i]);
+            if (s_nation == NO_NATION) continue;
+        }
+        if (!side.order_filter.mayContain(l_orderkey[i])) continue;
+        if (!SUPPLIER_FIRST) {
+            s_nation = side.valid_suppliers.find(l_suppkey[i]);
+            if (s_nation == NO_NATION) continue;
+        }
+        // Out-of-range keys of a direct map cannot match; any partition will do for them
+        const size_t p = static_cast<size_t>(std::min<uint64_t>(side.valid_orders.position(l_orderkey[i]) >> radix_shift_,
+                                                                num_partitions_ - 1));
+        partitions[p].push_back({l_orderkey[i], s_nation, l_extendedprice[i] * (DECIMAL_SCALE - l_discount[i])});
+    }
+}
+
+// Second half of a radix join: while a worker joins a partition, the rows of all workers for it
+// look up the same cache-sized slice of the order map
+template <typename Mask>
+void SharedScan<Mask>::joinPartitions(int num_threads) {
+    if (num_partitions_ == 0) return;
+    size_t buffered = 0;
+    for (const auto& worker_partitions : partitions_) {
+        for (const auto& partition : worker_partitions) buffered += partition.size();
+    }
+    ProfilePhase phase("radix_join", buffered);
+    parallelForMorsels(num_threads, num_partitions_, 1, [&](int worker_id, size_t begin, size_t end) {
+        const ProbeSide& side = sideOf(worker_id);
+        std::vector<NationSums>& partial = thread_results_[worker_id];
+        for (size_t p = begin; p < end; ++p) {
+            for (auto& worker_partitions : partitions_) {
+                for (const ProbeTuple& row : worker_partitions[p]) {
+                    const OrderMatch<Mask> order = side.valid_orders.find(row.orderkey);
+                    if (order.queries == 0 || row.s_nation != order.nation) continue;
+                    addRevenue(partial, order.queries, row.s_nation, row.revenue);
+                }
+                std::vector<ProbeTuple>().swap(worker_partitions[p]);
+            }
+        }
+    });
+    phase.setRowsOut(matchedRows());
+}
+
+// Aggregate results, naming only nations that had at least one matching lineitem
+template <typename Mask>
+void SharedScan<Mask>::finish(std::map<std::string, Revenue>* results) const {
+    for (const auto& partial : thread_results_) {
+        for (size_t q = 0; q < num_queries_; ++q) {
+            for (int32_t n_key = 0; n_key < NATION_KEY_LIMIT; ++n_key) {
+                if (partial[q].matches[n_key] > 0) {
+                    results[q][n_name_col_->dictionary[nation_key_to_name_[n_key]]] += partial[q].revenue[n_key];
+                }
+            }
+        }
+    }
+}
+
+template <typename Mask>
+uint64_t SharedScan<Mask>::matchedRows() const {
+    uint64_t matched = 0;
+    for (const auto& partial : thread_results_) {
+        for (const NationSums& sums : partial) {
+            for (uint64_t n : sums.matches) matched += n;
+        }
+    }
+    return matched;
+}
+
+// Calls run(Mask()) with the narrowest query mask type that fits num_queries, which keeps the
+// order build side small
+template <typename Run>
+static bool withQueryMask(size_t num_queries, Run run) {
+    if (num_queries <= 8) return run(uint8_t());
+    if (num_queries <= 16) return run(uint16_t());
+    if (num_queries <= 32) return run(uint32_t());
+    return run(uint64_t());
+}
+
+// Probes all num_rows rows of `lineitem`, workers claiming morsels until the table is exhausted
+template <typename Mask>
+static void probeTable(SharedScan<Mask>& scan, const LineitemColumns& lineitem, size_t num_rows, int num_threads) {
+    parallelForNodeMorsels(num_threads, num_rows, MORSEL_ROWS, [&](int worker_id, size_t begin, size_t end) {
+        scan.probe(worker_id, lineitem, begin, end);
+    });
+    scan.joinPartitions(num_threads);
+}
+
+// Function to execute several TPCH Query 5 instances with shared scans, MAX_SHARED_QUERIES per pass
+bool executeQuery5Shared(const std::vector<Query5Params>& queries, int num_threads,
+                         const ColumnTable& customer_data,
+                         const ColumnTable& orders_data,
+                         const ColumnTable& lineitem_data,
+                         const ColumnTable& supplier_data,
+                         const ColumnTable& nation_data,
+                         const ColumnTable& region_data,
+                         std::vector<std::map<std::string, Revenue>>& results,
+                         const QueryPlan& plan) {
+    results.assign(queries.size(), std::map<std::string, Revenue>());
+    LineitemColumns lineitem;
+    if (!lineitemColumns(lineitem_data, lineitem)) return false;
+    for (size_t first = 0; first < queries.size(); first += MAX_SHARED_QUERIES) {
+        const size_t count = std::min(MAX_SHARED_QUERIES, queries.size() - first);
+        const bool ok = withQueryMask(count, [&](auto mask) {
+            SharedScan<decltype(mask)> scan;
+            if (!scan.build(queries.data() + first, count, num_threads,
+                            customer_data, orders_data, supplier_data, nation_data, region_data,
+                            lineitem.orderkey_sorted, false, plan)) {
+                return false;
+            }
+            ProfilePhase probe_phase("lineitem_probe", lineitem_data.num_rows);
+            probeTable(scan, lineitem, lineitem_data.num_rows, num_threads);
+            probe_phase.finish(scan.matchedRows());
+            scan.finish(results.data() + first);
+            return true;
+        });
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// Streaming variant of executeQuery5Shared: each worker maps a chunk of lineitem.tbl, parses it,
+// probes it and frees it before taking the next, so lineitem is never materialized as a whole
+bool executeQuery5Streaming(const std::string& lineitem_path, const std::vector<Query5Params>& queries, int num_threads,
+                            const ColumnTable& customer_data,
+                            const ColumnTable& orders_data,
+                            const ColumnTable& supplier_data,
+                            const ColumnTable& nation_data,
+                            const ColumnTable& region_data,
+                            std::vector<std::map<std::string, Revenue>>& results,
+                            const QueryPlan& plan) {
+    results.assign(queries.size(), std::map<std::string, Revenue>());
+    for (size_t first = 0; first < queries.size(); first += MAX_SHARED_QUERIES) {
+        const size_t count = std::min(MAX_SHARED_QUERIES, queries.size() - first);
+        const bool ok = withQueryMask(count, [&](auto mask) {
+            ColumnTable lineitem_columns; // never filled: chunks are probed where they are parsed
+            TableLoad load;
+            if (!beginLoad(lineitem_path, LINEITEM_SCHEMA, QUERY5_COLUMNS, lineitem_columns, load)) return false;
+            // Every chunk has these columns; they are resolved again per chunk, without throwing
+            LineitemColumns lineitem;
+            if (!lineitemColumns(lineitem_columns, lineitem)) return false;
+            // The order of lineitem.tbl is only known once it is streamed, so the first chunk is parsed
+            // before the build and stands for the file: merge is only chosen by Auto if it is sorted
+            // (mergeRows stays exact, only slower, if a later chunk is not)
+            bool lineitem_sorted = true;
+            if (!load.chunks.empty()) {
+                parseChunk(load, 0);
+                const Column* l_orderkey = load.chunks[0].find("l_orderkey");
+                lineitem_sorted = l_orderkey && std::is_sorted(l_orderkey->ints.begin(), l_orderkey->ints.end());
+            }
+            SharedScan<decltype(mask)> scan;
+            if (!scan.build(queries.data() + first, count, num_threads,
+                            customer_data, orders_data, supplier_data, nation_data, region_data, lineitem_sorted, true,
+                            plan)) {
+                return false;
+            }
+            std::atomic<bool> chunks_ok{true};
+            ProfilePhase stream_phase("lineitem_stream", load.file->size());
+            const size_t prefetch_depth = PREFETCH_CHUNKS_PER_WORKER * std::max(num_threads, 1);
+            for (size_t k = 0; k < std::min(prefetch_depth, load.chunks.size()); ++k) prefetchChunk(load, k);
+            parallelForMorsels(num_threads, load.chunks.size(), 1, [&](int worker_id, size_t begin, size_t end) {
+                for (size_t k = begin; k < end; ++k) {
+                    if (k + prefetch_depth < load.chunks.size()) prefetchChunk(load, k + prefetch_depth);
+                    if (k != 0) parseChunk(load, k);
+                    LineitemColumns chunk;
+                    if (findLineitemColumns(load.chunks[k], chunk)) {
+                        scan.probe(worker_id, chunk, 0, load.chunks[k].num_rows);
+                    } else {
+                        chunks_ok = false;
+                    }
+                    load.chunks[k] = ColumnTable();
+                    load.file->release(load.bounds[k], load.bounds[k + 1]);
+                }
+            });
+            if (!chunks_ok) return false;
+            stream_phase.finish(scan.matchedRows());
+            scan.finish(results.data() + first);
+            return true;
+        });
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// Function to execute TPCH Query 5 using multithreading
+bool executeQuery5(const std::string& r_name, const std::string& start_date, const std::string& end_date, int num_threads,
+                   const ColumnTable& customer_data,
+                   const ColumnTable& orders_data,
+                   const ColumnTable& lineitem_data,
+                   const ColumnTable& supplier_data,
+                   const ColumnTable& nation_data,
+                   const ColumnTable& region_data,
+                   std::map<std::string, Revenue>& results,
+                   const QueryPlan& plan) {
+    std::vector<std::map<std::string, Revenue>> shared_results;
+    if (!executeQuery5Shared({{r_name, start_date, end_date}}, num_threads, customer_data, orders_data, lineitem_data,
+                             supplier_data, nation_data, region_data, shared_results, plan)) {
+        return false;
+    }
+    for (const auto& entry : shared_results[0]) results[entry.first] += entry.second;
+    return true;
+}
+
+// Query5Refresh keeps one scan per MAX_SHARED_QUERIES queries, each with the narrowest query mask
+// type that fits, behind this interface
+class RefreshScan {
+public:
+    virtual ~RefreshScan() = default;
+    virtual void addOrders(const ColumnTable& orders_delta, int num_threads) = 0;
+    virtual void probe(const LineitemColumns& lineitem_delta, size_t num_rows, int num_threads) = 0;
+    virtual void finish(std::map<std::string, Revenue>* results) const = 0;
+};
+
+template <typename Mask>
+class RefreshScanOf : public RefreshScan {
+public:
+    void addOrders(const ColumnTable& orders_delta, int num_threads) override { scan.addOrders(orders_delta, num_threads); }
+    void probe(const LineitemColumns& lineitem_delta, size_t num_rows, int num_threads) override {
+        probeTable(scan, lineitem_delta, num_rows, num_threads);
+    }
+    void finish(std::map<std::string, Revenue>* results) const override { scan.finish(results); }
+
+    SharedScan<Mask> scan{true};
+};
+
+struct Query5Refresh::State {
+    int num_threads = 1;
+    size_t num_queries = 0;
+    std::vector<std::unique_ptr<RefreshScan>> scans; // scans[i] answers queries from i * MAX_SHARED_QUERIES on
+};
+
+Query5Refresh::Query5Refresh() = default;
+Query5Refresh::~Query5Refresh() = default;
+
+bool Query5Refresh::start(const std::vector<Query5Params>& queries, int num_threads,
+                          const ColumnTable& customer_data,
+                          const ColumnTable& orders_data,
+                          const ColumnTable& lineitem_data,
+                          const ColumnTable& supplier_data,
+                          const ColumnTable& nation_data,
+                          const ColumnTable& region_data,
+                          const QueryPlan& plan) {
+    std::unique_ptr<State> state(new State);
+    state->num_threads = num_threads;
+    state->num_queries = queries.size();
+    LineitemColumns lineitem;
+    if (!lineitemColumns(lineitem_data, lineitem)) return false;
+    for (size_t first = 0; first < queries.size(); first += MAX_SHARED_QUERIES) {
+        const size_t count = std::min(MAX_SHARED_QUERIES, queries.size() - first);
+        const bool ok = withQueryMask(count, [&](auto mask) {
+            std::unique_ptr<RefreshScanOf<decltype(mask)>> refresh_scan(new RefreshScanOf<decltype(mask)>);
+            // Deltas may break the order of lineitem; a merge join chosen now stays exact regardless
+            if (!refresh_scan->scan.build(queries.data() + first, count, num_threads,
+                                          customer_data, orders_data, supplier_data, nation_data, region_data,
+                                          lineitem.orderkey_sorted, false, plan)) {
+                return false;
+            }
+            ProfilePhase probe_phase("lineitem_probe", lineitem_data.num_rows);
+            probeTable(refresh_scan->scan, lineitem, lineitem_data.num_rows, num_threads);
+            probe_phase.finish(refresh_scan->scan.matchedRows());
+            state->scans.push_back(std::move(refresh_scan));
+            return true;
+        });
+        if (!ok) return false;
+    }
+    state_ = std::move(state);
+    return true;
+}
+
+// Both deltas are checked before either is applied. Orders go first, so that lineitems of orders
+// in the same delta find them.
+bool Query5Refresh::apply(const ColumnTable& orders_delta, const ColumnTable& lineitem_delta) {
+    if (!state_) return false;
+    LineitemColumns lineitem;
+    if (!SharedScan<uint8_t>::checkOrders(orders_delta) ||
+        (lineitem_delta.num_rows > 0 && !lineitemColumns(lineitem_delta, lineitem))) {
+        return false;
+    }
+    for (auto& scan : state_->scans) scan->addOrders(orders_delta, state_->num_threads);
+    if (lineitem_delta.num_rows > 0) {
+        ProfilePhase phase("lineitem_refresh", lineitem_delta.num_rows);
+        for (auto& scan : state_->scans) scan->probe(lineitem, lineitem_delta.num_rows, state_->num_threads);
+    }
+    return true;
+}
+
+void Query5Refresh::results(std::vector<std::map<std::string, Revenue>>& results) const {
+    results.assign(state_ ? state_->num_queries : 0, std::map<std::string, Revenue>());
+    if (!state_) return;
+    for (size_t i = 0; i < state_->scans.size(); ++i) state_->scans[i]->finish(results.data() + i * MAX_SHARED_QUERIES);
+}
+
+// Formats a fixed-point revenue with its four decimal digits, e.g. 123456789 -> "12345.6789"
+static std::string formatRevenue(Revenue revenue) {
+    static_assert(REVENUE_SCALE == 10000, "formatRevenue prints four fraction digits");
+    const bool negative = revenue < 0;
+    const uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(revenue) : static_cast<uint64_t>(revenue);
+    std::string fraction = std::to_string(magnitude % REVENUE_SCALE);
+    fraction.insert(0, 4 - fraction.size(), '0');
+    return (negative ? "-" : "") + std::to_string(magnitude / REVENUE_SCALE) + "." + fraction;
+}
+
+// Writes `results` sorted by revenue descending (Query requirement), one "<prefix>n_name|revenue" line each
+static void writeResults(std::ostream& out, const std::map<std::string, Revenue>& results, const std::string& prefix) {
+    ProfilePhase phase("output", results.size());
+    // Copy map to vector of pairs for sorting
+    std::vector<std::pair<std::string, Revenue>> sorted_results(results.begin(), results.end());
+
+    // Revenues are exact, so ties are real; break them by name to keep the output deterministic
+    std::sort(sorted_results.begin(), sorted_results.end(),
+        [](const std::pair<std::string, Revenue>& a, const std::pair<std::string, Revenue>& b) {
+            if (a.second != b.second) return a.second > b.second; // Descending order
+            return a.first < b.first;
+        });
+
+    for (const auto& pair : sorted_results) {
+        out << prefix << pair.first << "|" << formatRevenue(pair.second) << "\n";
+    }
+    phase.setRowsOut(sorted_results.size());
+}
+
+bool outputResults(const std::string& result_path, const std::map<std::string, Revenue>& results) {
+    if (result_path == "-") {
+        writeResults(std::cout, results, "");
+        std::cout.flush();
+        return true;
+    }
+    std::ofstream outfile(result_path);
+    if (!outfile.is_open()) return false;
+
+    writeResults(outfile, results, "");
+
+    outfile.close();
+    return true;
+}
+
+std::string profilePath(const std::string& result_path) {
+    if (result_path == "-") return "query5.profile.json";
+    struct stat st;
+    if (::stat(result_path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) return result_path + "/query5.profile.json";
+    return result_path + ".profile.json";
+}
+
+bool parseQueryLine(const std::string& line, Query5Params& params) {
+    size_t first = line.find('|');
+    size_t second = first == std::string::npos ? first : line.find('|', first + 1);
+    if (second == std::string::npos) return false;
+    size_t third = line.find('|', second + 1);
+    params.r_name = line.substr(0, first);
+    params.start_date = line.substr(first + 1, second - first - 1);
+    params.end_date = line.substr(second + 1, third == std::string::npos ? std::string::npos : third - second - 1);
+    if (!params.end_date.empty() && params.end_date.back() == '\r') params.end_date.pop_back();
+    return !params.r_name.empty() && isValidDate(params.start_date) && isValidDate(params.end_date);
+}
+
+// Calls on_query with each query of a batch, skipping empty lines and '#' comments. A bad line is
+// reported and skipped; returns false if there was any.
+template <typename Fn>
+static bool readQueryLines(std::istream& lines, Fn&& on_query) {
+    bool ok = true;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(lines, line)) {
+        ++line_number;
+        if (line.empty() || line[0] == '#') continue;
+        Query5Params params;
+        if (!parseQueryLine(line, params)) {
+            std::cerr << "Bad query on line " << line_number << ": " << line << std::endl;
+            ok = false;
+            continue;
+        }
+        on_query(params);
+    }
+    return ok;
+}
+
+// Writes results[q] for every query of a batch: to a file per query in directory result_path if
+// per_query_files is set, else as "r_name|start|end|n_name|revenue" lines to `combined`
+static bool writeBatchResults(const std::vector<Query5Params>& queries, const std::vector<std::map<std::string, Revenue>>& results,
+                              bool per_query_files, const std::string& result_path, std::ostream* combined) {
+    bool ok = true;
+    for (size_t q = 0; q < queries.size(); ++q) {
+        const Query5Params& params = queries[q];
+        if (per_query_files) {
+            std::string name = "q5_" + params.r_name + "_" + params.start_date + "_" + params.end_date + ".txt";
+            std::replace(name.begin(), name.end(), ' ', '_');
+            ok = outputResults(result_path + "/" + name, results[q]) && ok;
+        } else {
+            writeResults(*combined, results[q], params.r_name + "|" + params.start_date + "|" + params.end_date + "|");
+        }
+    }
+    return ok;
+}
+
+bool runQuery5Batch(std::istream& queries, const std::string& result_path, int num_threads,
+                    const ColumnTable& customer_data,
+                    const ColumnTable& orders_data,
+                    const ColumnTable& lineitem_data,
+                    const ColumnTable& supplier_data,
+                    const ColumnTable& nation_data,
+                    const ColumnTable& region_data,
+                    size_t queries_per_scan,
+                    const QueryPlan& plan) {
+    queries_per_scan = std::max<size_t>(queries_per_scan, 1);
+    struct stat st;
+    const bool per_query_files = ::stat(result_path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    std::ofstream combined_file;
+    std::ostream* combined = nullptr;
+    if (!per_query_files) {
+        if (result_path == "-") {
+            combined = &std::cout;
+        } else {
+            combined_file.open(result_path);
+            if (!combined_file.is_open()) return false;
+            combined = &combined_file;
+        }
+    }
+
+    bool ok = true;
+    std::vector<Query5Params> pending;
+    auto runPending = [&]() {
+        std::vector<std::map<std::string, Revenue>> results;
+        if (!executeQuery5Shared(pending, num_threads, customer_data, orders_data, lineitem_data,
+                                 supplier_data, nation_data, region_data, results, plan)) {
+            std::cerr << "Query batch failed" << std::endl;
+            ok = false;
+            pending.clear();
+            return;
+        }
+        ok = writeBatchResults(pending, results, per_query_files, result_path, combined) && ok;
+        // Flush per scan so a reader on the other end of a pipe sees each result as it completes
+        if (combined) combined->flush();
+        pending.clear();
+    };
+
+    const bool lines_ok = readQueryLines(queries, [&](const Query5Params& params) {
+        pending.push_back(params);
+        if (pending.size() >= queries_per_scan) runPending();
+    });
+    if (!pending.empty()) runPending();
+    return lines_ok && ok;
+}
+
+bool readQuery5Batch(std::istream& lines, std::vector<Query5Params>& queries) {
+    return readQueryLines(lines, [&](const Query5Params& params) { queries.push_back(params); });
+}
+
+bool runQuery5Refresh(std::istream& deltas, const std::vector<Query5Params>& queries, bool batch_output,
+                      const std::string& result_path, int num_threads,
+                      const ColumnTable& customer_data,
+                      const ColumnTable& orders_data,
+                      const ColumnTable& lineitem_data,
+                      const ColumnTable& supplier_data,
+                      const ColumnTable& nation_data,
+                      const ColumnTable& region_data,
+                      const QueryPlan& plan) {
+    Query5Refresh refresh;
+    if (queries.empty() || !refresh.start(queries, num_threads, customer_data, orders_data, lineitem_data,
+                                          supplier_data, nation_data, region_data, plan)) {
+        std::cerr << "Query refresh failed" << std::endl;
+        return false;
+    }
+    struct stat st;
+    const bool per_query_files = ::stat(result_path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    // Result files are rewritten with the current results; stdout gets every round, one after another
+    auto writeCurrent = [&]() {
+        std::vector<std::map<std::string, Revenue>> results;
+        refresh.results(results);
+        if (!batch_output) {
+            return outputResults(result_path, results[0]);
+        }
+        std::ofstream combined_file;
+        std::ostream* combined = &std::cout;
+        if (!per_query_files && result_path != "-") {
+            combined_file.open(result_path);
+            if (!combined_file.is_open()) return false;
+            combined = &combined_file;
+        }
+        const bool written = writeBatchResults(queries, results, per_query_files, result_path, combined);
+        combined->flush();
+        return written;
+    };
+    bool ok = writeCurrent();
+
+    std::string line;
+    while (ok && std::getline(deltas, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        const std::string path_suffix = line.back() == '/' ? "" : "/";
+        ColumnTable orders_delta, lineitem_delta;
+        // A delta may leave out either file, but not both: that is a mistyped or missing directory
+        const std::pair<const TableSchema*, ColumnTable*> tables[] = {{&ORDERS_SCHEMA, &orders_delta}, {&LINEITEM_SCHEMA, &lineitem_delta}};
+        bool any_file = false;
+        for (const auto& table : tables) {
+            const std::string path = line + path_suffix + table.first->name + ".tbl";
+            if (::stat(path.c_str(), &st) != 0) {
+                if (errno == ENOENT) continue;
+                std::cerr << "Cannot access delta " << path << ": " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            any_file = true;
+            if (!loadTable(path, *table.first, QUERY5_COLUMNS, *table.second, num_threads)) {
+                std::cerr << "Failed to load delta " << path << std::endl;
+                return false;
+            }
+        }
+        if (!any_file) {
+            std::cerr << "Delta " << line << " holds neither orders.tbl nor lineitem.tbl" << std::endl;
+            return false;
+        }
+        ok = refresh.apply(orders_delta, lineitem_delta) && writeCurrent();
+    }
+    return ok;
+}
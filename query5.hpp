@@ -0,0 +1,273 @@
+#ifndef QUERY5_HPP
+#define QUERY5_HPP
+
+#include "numa.hpp"
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Physical type of a column as stored in a ColumnTable
+enum class ColumnType {
+    Int32,   // keys and small integers
+    Date,    // day number (days since 1970-01-01)
+    Decimal, // fixed-point, scaled by DECIMAL_SCALE
+    String   // dictionary-coded
+};
+
+// Decimal columns (prices, discounts, balances) are stored as value * DECIMAL_SCALE
+const int64_t DECIMAL_SCALE = 100;
+
+struct ColumnDef {
+    std::string name;
+    ColumnType type;
+};
+
+// Schema descriptor of a .tbl file: table name and its columns in file order
+struct TableSchema {
+    std::string name;
+    std::vector<ColumnDef> columns;
+};
+
+extern const TableSchema CUSTOMER_SCHEMA;
+extern const TableSchema ORDERS_SCHEMA;
+extern const TableSchema LINEITEM_SCHEMA;
+extern const TableSchema SUPPLIER_SCHEMA;
+extern const TableSchema NATION_SCHEMA;
+extern const TableSchema REGION_SCHEMA;
+
+// Rows per zone-map block
+const size_t ZONE_ROWS = 1024;
+
+// One contiguous, typed array per column. Only the vector matching `type` is used:
+// Int32/Date values and String codes live in `ints`, Decimal values in `decimals`.
+struct Column {
+    std::string name;
+    ColumnType type;
+    std::vector<int32_t> ints;
+    std::vector<int64_t> decimals;
+    std::vector<std::string> dictionary; // String code -> value
+    // Zone map of a Date column: min and max day of each block of ZONE_ROWS rows
+    std::vector<int32_t> zone_min;
+    std::vector<int32_t> zone_max;
+    // Int32 and Date columns: no value is smaller than the one before it (e.g. dbgen's l_orderkey)
+    bool sorted = false;
+};
+
+struct ColumnTable {
+    const TableSchema* schema = nullptr;
+    size_t num_rows = 0;
+    std::vector<Column> columns;
+
+    // Throws std::out_of_range if the table has no such column
+    const Column& column(const std::string& name) const;
+    // nullptr if the table has no such column
+    const Column* find(const std::string& name) const;
+};
+
+// Query 5 revenue, sum(l_extendedprice * (1 - l_discount)), in fixed point scaled by REVENUE_SCALE.
+// Sums are exact, so results do not depend on the number of threads or the order rows are summed in.
+// One lineitem contributes at most about 1e9, leaving room for billions of rows per nation.
+using Revenue = int64_t;
+const int64_t REVENUE_SCALE = DECIMAL_SCALE * DECIMAL_SCALE;
+
+// True if `date` is a calendar date in YYYY-MM-DD form
+bool isValidDate(const std::string& date);
+
+// Converts a YYYY-MM-DD date to a day number; throws std::invalid_argument if it is not valid
+int32_t dateToDayNumber(const std::string& date);
+
+// How orders are joined with lineitem
+enum class JoinStrategy {
+    Auto,  // merge for inputs sorted by order key, else radix once the order build side is too large
+           // for the cache, else hash
+    Hash,  // every lineitem looks its order up directly
+    Radix, // lineitems are buffered by the part of the order map they read, then joined part by part;
+           // Hash with a streamed lineitem, which is never buffered
+    Merge  // qualifying orders sorted by key are merged with lineitem; Auto's choice when both are sorted
+};
+
+// A choice left to the data (Auto) or forced either way
+enum class KernelChoice { Auto, Off, On };
+
+// Instantiation of the hash-join probe kernel. The kernel is compiled for each join order and each
+// layout of the order map and order filter, so its loop tests none of them; a query picks the one
+// matching its build side. Auto leaves a choice to the build side's statistics: the cost model
+// orders the checks, key density picks the layouts.
+struct ProbeKernelOptions {
+    KernelChoice supplier_first = KernelChoice::Auto; // check the supplier before the order filter
+    KernelChoice direct_orders = KernelChoice::Auto;  // direct-addressed order map instead of a hash table
+    KernelChoice bitmap_filter = KernelChoice::Auto;  // exact bitmap order filter instead of a Bloom filter
+};
+
+// How a query is executed; everything defaults to Auto. Each query takes its own plan, so queries
+// running concurrently in one process may choose differently.
+struct QueryPlan {
+    JoinStrategy join = JoinStrategy::Auto;
+    ProbeKernelOptions probe_kernel; // e.g. for benchmarks comparing the instantiations on the same data
+};
+
+// Optional settings beyond the required Query 5 arguments
+struct RunOptions {
+    bool pin_threads = false;               // --pin_threads: pin thread pool workers to CPUs
+    std::string cache_dir;                  // --cache_dir: directory of binary table snapshots, empty to disable
+    std::string batch_file;                 // --batch: file of query parameter lines ("-" for stdin), see runQuery5Batch
+    bool stream_lineitem = false;           // --stream: probe lineitem.tbl chunk by chunk instead of loading it
+    bool profile = false;                   // --profile: record per-phase timings and counters, see profilePath
+    NumaMode numa = NumaMode::Off;          // --numa local|interleave: NUMA placement and pinning, see NumaPlacement
+    QueryPlan plan;                         // --join auto|hash|radix|merge sets plan.join
+    std::string refresh_file;               // --refresh: file of delta directories ("-" for stdin), see runQuery5Refresh
+};
+
+bool parseArgs(int argc, char* argv[], std::string& r_name, std::string& start_date, std::string& end_date, int& num_threads, std::string& table_path, std::string& result_path);
+bool parseArgs(int argc, char* argv[], std::string& r_name, std::string& start_date, std::string& end_date, int& num_threads, std::string& table_path, std::string& result_path, RunOptions& options);
+
+// Columns read by executeQuery5, used as the default load projection
+extern const std::vector<std::string> QUERY5_COLUMNS;
+// QUERY5_COLUMNS without the lineitem columns, for loading the build side of a streaming query
+extern const std::vector<std::string> QUERY5_BUILD_COLUMNS;
+
+// Loads the columns of `schema` named in `projection` (all columns if empty), parsing with num_threads threads
+bool loadTable(const std::string& filepath, const TableSchema& schema, const std::vector<std::string>& projection, ColumnTable& table, int num_threads = 1);
+
+// Computes the zone maps of the Date columns of `table` and which of its Int32 and Date columns are
+// sorted; loadTable and readTPCHData do this already
+void buildZoneMaps(ColumnTable& table, int num_threads = 1);
+
+bool readTPCHData(const std::string& table_path,
+                  ColumnTable& customer_data,
+                  ColumnTable& orders_data,
+                  ColumnTable& lineitem_data,
+                  ColumnTable& supplier_data,
+                  ColumnTable& nation_data,
+                  ColumnTable& region_data,
+                  int num_threads = 1,
+                  const std::vector<std::string>& projection = QUERY5_COLUMNS,
+                  const std::string& cache_dir = "");
+
+bool executeQuery5(const std::string& r_name, const std::string& start_date, const std::string& end_date, int num_threads,
+                   const ColumnTable& customer_data,
+                   const ColumnTable& orders_data,
+                   const ColumnTable& lineitem_data,
+                   const ColumnTable& supplier_data,
+                   const ColumnTable& nation_data,
+                   const ColumnTable& region_data,
+                   std::map<std::string, Revenue>& results,
+                   const QueryPlan& plan = QueryPlan());
+
+// Writes `results` to result_path, or to stdout if it is "-"
+bool outputResults(const std::string& result_path, const std::map<std::string, Revenue>& results);
+
+// Where --profile writes its JSON report: next to the result file, inside a result directory,
+// or in the working directory when results go to stdout
+std::string profilePath(const std::string& result_path);
+
+// Parameters of one Query 5 instance
+struct Query5Params {
+    std::string r_name;
+    std::string start_date;
+    std::string end_date;
+};
+
+// Parses a batch line of the form "r_name|start_date|end_date"; both dates must be valid
+bool parseQueryLine(const std::string& line, Query5Params& params);
+
+// Most queries checked together by one shared scan; larger sets are run in several passes
+const size_t MAX_SHARED_QUERIES = 64;
+
+// Executes all `queries` with shared scans: each table, including lineitem, is read once per
+// MAX_SHARED_QUERIES queries rather than once per query. results[q] receives the result of queries[q].
+bool executeQuery5Shared(const std::vector<Query5Params>& queries, int num_threads,
+                         const ColumnTable& customer_data,
+                         const ColumnTable& orders_data,
+                         const ColumnTable& lineitem_data,
+                         const ColumnTable& supplier_data,
+                         const ColumnTable& nation_data,
+                         const ColumnTable& region_data,
+                         std::vector<std::map<std::string, Revenue>>& results,
+                         const QueryPlan& plan = QueryPlan());
+
+// Executes `queries` like executeQuery5Shared, but streams lineitem from lineitem_path instead of
+// taking a loaded table: each worker parses one LOAD_MORSEL_BYTES chunk at a time, probes it and
+// frees it, so memory stays at the build sides plus one chunk per thread. A radix join would buffer
+// lineitem until the end of the stream, so JoinStrategy::Radix runs as Hash here. Auto takes lineitem
+// as sorted by order key if its first chunk is. The other tables only need QUERY5_BUILD_COLUMNS loaded.
+bool executeQuery5Streaming(const std::string& lineitem_path, const std::vector<Query5Params>& queries, int num_threads,
+                            const ColumnTable& customer_data,
+                            const ColumnTable& orders_data,
+                            const ColumnTable& supplier_data,
+                            const ColumnTable& nation_data,
+                            const ColumnTable& region_data,
+                            std::vector<std::map<std::string, Revenue>>& results,
+                            const QueryPlan& plan = QueryPlan());
+
+// Runs every query line read from `queries` against tables loaded once, up to queries_per_scan
+// of them per shared scan (use 1 to answer each line as soon as it arrives, e.g. on a pipe).
+// Empty lines and lines starting with '#' are skipped. If result_path is a directory, each query
+// gets its own result file there; otherwise all results go to result_path ("-" for stdout) as
+// "r_name|start|end|n_name|revenue" lines, flushed after each scan.
+bool runQuery5Batch(std::istream& queries, const std::string& result_path, int num_threads,
+                    const ColumnTable& customer_data,
+                    const ColumnTable& orders_data,
+                    const ColumnTable& lineitem_data,
+                    const ColumnTable& supplier_data,
+                    const ColumnTable& nation_data,
+                    const ColumnTable& region_data,
+                    size_t queries_per_scan = MAX_SHARED_QUERIES,
+                    const QueryPlan& plan = QueryPlan());
+
+// Reads every query line of a batch as runQuery5Batch does, reporting bad lines; false if any was bad
+bool readQuery5Batch(std::istream& lines, std::vector<Query5Params>& queries);
+
+// Keeps the results of a set of queries current as orders and lineitems are appended, reading no
+// row twice. start() runs the queries like executeQuery5Shared but keeps their build sides and
+// per-nation sums; apply() then filters only the appended orders into the build sides and probes
+// only the appended lineitems, so an apply() costs about the size of its deltas. Customers,
+// suppliers, nations and regions are taken as fixed, and the tables given to start() must outlive
+// the object. An appended lineitem is counted only if its order is in the base data or in the same
+// or an earlier apply(), as with dbgen's refresh sets.
+class Query5Refresh {
+public:
+    Query5Refresh();
+    ~Query5Refresh();
+
+    bool start(const std::vector<Query5Params>& queries, int num_threads,
+               const ColumnTable& customer_data,
+               const ColumnTable& orders_data,
+               const ColumnTable& lineitem_data,
+               const ColumnTable& supplier_data,
+               const ColumnTable& nation_data,
+               const ColumnTable& region_data,
+               const QueryPlan& plan = QueryPlan());
+
+    // Adds the rows of orders_delta, then those of lineitem_delta. Each holds the QUERY5_COLUMNS of
+    // its table or has no rows. Returns false, applying neither, if start() has not succeeded or a
+    // delta with rows lacks one of the columns.
+    bool apply(const ColumnTable& orders_delta, const ColumnTable& lineitem_delta);
+
+    // results[q] receives the current result of query q
+    void results(std::vector<std::map<std::string, Revenue>>& results) const;
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+// Runs `queries` with a Query5Refresh, then applies every delta named by a line of `deltas`: a
+// directory holding orders.tbl and/or lineitem.tbl with the rows appended since the previous delta.
+// Returns false, after the results of the deltas before it, at a delta holding neither file.
+// Results are written after the first run and rewritten after every delta, in runQuery5Batch's
+// layout if batch_output is set and as by outputResults (for queries[0]) otherwise.
+bool runQuery5Refresh(std::istream& deltas, const std::vector<Query5Params>& queries, bool batch_output,
+                      const std::string& result_path, int num_threads,
+                      const ColumnTable& customer_data,
+                      const ColumnTable& orders_data,
+                      const ColumnTable& lineitem_data,
+                      const ColumnTable& supplier_data,
+                      const ColumnTable& nation_data,
+                      const ColumnTable& region_data,
+                      const QueryPlan& plan = QueryPlan());
+
+#endif // QUERY5_HPP
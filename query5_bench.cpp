@@ -0,0 +1,238 @@
+// Google Benchmark suite for the Query 5 engine. Tables come from the in-process generator, once per
+// scale factor, and are written to a temporary directory as .tbl files only for the benchmarks that
+// read files; scale factors are given in hundredths (10 = SF 0.1).
+//   BM_Generate        in-memory generation of all tables, swept over thread counts
+//   BM_DelimiterScan   delimiter scanning of lineitem text
+//   BM_LoadTable       projected, single-threaded load of lineitem.tbl
+//   BM_Phases          one query with the time of every profiled phase reported as a counter
+//   BM_Query5          query only (tables in memory), swept over thread counts
+//   BM_ProbeKernel     query only with the hash join, one thread, once per probe kernel instantiation
+//   BM_EndToEnd        load + query, swept over thread counts
+// The thread sweeps report rows/s and scaling efficiency relative to the 1-thread run.
+
+#include "query5.hpp"
+#include "profile.hpp"
+#include "tbl_scan.hpp"
+#include "tpch_gen.hpp"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// Synthetic data set of one scale factor: the generated tables (all columns), and a directory
+// holding them as .tbl files, written on first use by the benchmarks that read files
+struct DataSet {
+    ColumnTable customer, orders, lineitem, supplier, nation, region;
+    std::string dir;
+};
+
+const uint64_t SEED = 42;
+
+int hardwareThreads() {
+    return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+DataSet& dataSet(int sf_hundredths) {
+    static std::map<int, std::unique_ptr<DataSet>> data_sets;
+    std::unique_ptr<DataSet>& data = data_sets[sf_hundredths];
+    if (!data) {
+        data.reset(new DataSet);
+        generateTPCHData(sf_hundredths / 100.0, SEED, hardwareThreads(), data->customer, data->orders, data->lineitem,
+                         data->supplier, data->nation, data->region, {});
+    }
+    return *data;
+}
+
+const std::string& tableDir(int sf_hundredths) {
+    DataSet& data = dataSet(sf_hundredths);
+    if (data.dir.empty()) {
+        data.dir = (std::filesystem::temp_directory_path() / ("query5_bench_sf" + std::to_string(sf_hundredths))).string();
+        std::filesystem::create_directories(data.dir);
+        const std::pair<const char*, const ColumnTable*> tables[] = {
+            {"customer", &data.customer}, {"orders", &data.orders}, {"lineitem", &data.lineitem},
+            {"supplier", &data.supplier}, {"nation", &data.nation}, {"region", &data.region}};
+        for (const auto& table : tables) writeTbl(data.dir + "/" + table.first + ".tbl", *table.second);
+    }
+    return data.dir;
+}
+
+void removeDataSets() {
+    for (int sf : {1, 5, 10}) {
+        std::filesystem::remove_all(std::filesystem::temp_directory_path() / ("query5_bench_sf" + std::to_string(sf)));
+    }
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+bool runQuery(const DataSet& data, int num_threads, std::map<std::string, Revenue>& results,
+              const QueryPlan& plan = QueryPlan()) {
+    return executeQuery5("ASIA", "1994-01-01", "1995-01-01", num_threads, data.customer, data.orders, data.lineitem,
+                         data.supplier, data.nation, data.region, results, plan);
+}
+
+// Time of the 1-thread run per benchmark and scale factor, the baseline for scaling efficiency
+std::map<std::pair<std::string, int>, double>& singleThreadSeconds() {
+    static std::map<std::pair<std::string, int>, double> seconds;
+    return seconds;
+}
+
+void reportScaling(benchmark::State& state, const std::string& name, double seconds, size_t rows) {
+    const int sf = static_cast<int>(state.range(0));
+    const int threads = static_cast<int>(state.range(1));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * rows));
+    const double per_iteration = seconds / static_cast<double>(state.iterations());
+    if (threads == 1) singleThreadSeconds()[{name, sf}] = per_iteration;
+    auto baseline = singleThreadSeconds().find({name, sf});
+    if (baseline != singleThreadSeconds().end() && per_iteration > 0) {
+        state.counters["efficiency"] = baseline->second / (per_iteration * threads);
+    }
+}
+
+void BM_Generate(benchmark::State& state) {
+    const int threads = static_cast<int>(state.range(1));
+    double seconds = 0;
+    size_t rows = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        DataSet generated;
+        generateTPCHData(state.range(0) / 100.0, SEED, threads, generated.customer, generated.orders, generated.lineitem,
+                         generated.supplier, generated.nation, generated.region, {});
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        rows = generated.lineitem.num_rows;
+    }
+    reportScaling(state, "generate", seconds, rows);
+}
+
+void BM_DelimiterScan(benchmark::State& state) {
+    const std::string text = readFile(tableDir(static_cast<int>(state.range(0))) + "/lineitem.tbl");
+    for (auto _ : state) {
+        DelimiterScanner scanner(text.data(), text.data() + text.size());
+        size_t delimiters = 0;
+        for (const char* p = scanner.next(text.data()); p < text.data() + text.size(); p = scanner.next(p + 1)) ++delimiters;
+        benchmark::DoNotOptimize(delimiters);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+void BM_LoadTable(benchmark::State& state) {
+    const std::string path = tableDir(static_cast<int>(state.range(0))) + "/lineitem.tbl";
+    const size_t bytes = std::filesystem::file_size(path);
+    for (auto _ : state) {
+        ColumnTable table;
+        loadTable(path, LINEITEM_SCHEMA, QUERY5_COLUMNS, table, 1);
+        benchmark::DoNotOptimize(table.num_rows);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+
+void BM_Phases(benchmark::State& state) {
+    const DataSet& data = dataSet(static_cast<int>(state.range(0)));
+    const char* const phases[] = {"region_nation_filter", "customer_filter", "supplier_filter", "orders_filter", "lineitem_probe"};
+    Profiler& profiler = Profiler::instance();
+    const bool was_enabled = profiler.enabled();
+    profiler.enable();
+    std::map<std::string, double> totals;
+    for (auto _ : state) {
+        profiler.reset();
+        std::map<std::string, Revenue> results;
+        runQuery(data, 1, results);
+        for (const char* phase : phases) totals[phase] += profiler.phaseSeconds(phase);
+    }
+    for (const char* phase : phases) {
+        state.counters[std::string(phase) + "_ms"] = 1000.0 * totals[phase] / static_cast<double>(state.iterations());
+    }
+    // Leave the benchmarks that follow unprofiled, as they were before
+    if (!was_enabled) profiler.disable();
+    profiler.reset();
+}
+
+void BM_Query5(benchmark::State& state) {
+    const DataSet& data = dataSet(static_cast<int>(state.range(0)));
+    const int threads = static_cast<int>(state.range(1));
+    double seconds = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        std::map<std::string, Revenue> results;
+        runQuery(data, threads, results);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        benchmark::DoNotOptimize(results);
+    }
+    reportScaling(state, "query", seconds, data.lineitem.num_rows);
+}
+
+// range(1) bits 0-2 force the kernel's supplier_first, direct_orders and bitmap_filter choices
+void BM_ProbeKernel(benchmark::State& state) {
+    const DataSet& data = dataSet(static_cast<int>(state.range(0)));
+    const int kernel = static_cast<int>(state.range(1));
+    auto choice = [&](int bit) { return kernel >> bit & 1 ? KernelChoice::On : KernelChoice::Off; };
+    QueryPlan plan;
+    plan.join = JoinStrategy::Hash;
+    plan.probe_kernel.supplier_first = choice(0);
+    plan.probe_kernel.direct_orders = choice(1);
+    plan.probe_kernel.bitmap_filter = choice(2);
+    state.SetLabel(std::string(kernel & 1 ? "supplier_first" : "orders_first") + (kernel & 2 ? "/direct" : "/hash") +
+                   (kernel & 4 ? "/bitmap" : "/bloom"));
+    for (auto _ : state) {
+        std::map<std::string, Revenue> results;
+        runQuery(data, 1, results, plan);
+        benchmark::DoNotOptimize(results);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * data.lineitem.num_rows));
+}
+
+void BM_EndToEnd(benchmark::State& state) {
+    const DataSet& data = dataSet(static_cast<int>(state.range(0)));
+    const std::string& dir = tableDir(static_cast<int>(state.range(0)));
+    const int threads = static_cast<int>(state.range(1));
+    double seconds = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        DataSet loaded;
+        readTPCHData(dir, loaded.customer, loaded.orders, loaded.lineitem, loaded.supplier, loaded.nation, loaded.region, threads);
+        std::map<std::string, Revenue> results;
+        runQuery(loaded, threads, results);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        benchmark::DoNotOptimize(results);
+    }
+    reportScaling(state, "end_to_end", seconds, data.lineitem.num_rows);
+}
+
+// (scale factor, threads) pairs: every scale factor with 1, 2, 4, ... up to the number of CPUs
+void threadSweep(benchmark::internal::Benchmark* bench) {
+    const int max_threads = std::max(2, hardwareThreads());
+    for (int sf : {1, 5, 10}) {
+        for (int threads = 1; threads < max_threads; threads *= 2) bench->Args({sf, threads});
+        bench->Args({sf, max_threads});
+    }
+}
+
+} // namespace
+
+BENCHMARK(BM_Generate)->Apply(threadSweep)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DelimiterScan)->Arg(1)->Arg(10)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoadTable)->Arg(1)->Arg(10)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Phases)->Arg(1)->Arg(10)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Query5)->Apply(threadSweep)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ProbeKernel)->ArgsProduct({{1, 10}, {0, 1, 2, 3, 4, 5, 6, 7}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EndToEnd)->Apply(threadSweep)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    removeDataSets();
+    return 0;
+}
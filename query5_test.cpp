@@ -0,0 +1,479 @@
+// Consistency test for the Query 5 engine, run by ctest. On generated tables, every JoinStrategy
+// with every ProbeKernelOptions combination, and a Query5Refresh fed the tables as a base and
+// three deltas, must give the result of a naive row-at-a-time Query 5, at 1, 2 and more threads;
+// so must the text outputResults writes. A lineitem lacking a column Query 5 reads must fail the
+// query rather than the process. loadTable must read what writeTbl wrote back with "\r\n" line
+// endings and without the '|' after the last field as well, and a lineitem.tbl loaded in several
+// chunks, at 1, 2 and more threads, with every string decoding as generated. runQuery5Batch must
+// write the naive results of a batch and report its bad lines. executeQuery5Streaming must give the
+// naive results over a lineitem.tbl of several chunks, sorted or not.
+// Prints each mismatch and exits nonzero if there was any.
+
+#include "query5.hpp"
+#include "tpch_gen.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdlib.h>
+
+namespace {
+
+const double SCALE_FACTOR = 0.05;
+const double LOAD_SCALE_FACTOR = 0.02; // of the tables generated with every column for the loader
+const size_t LOAD_CHUNK_BYTES = 4 << 20; // LOAD_MORSEL_BYTES in query5.cpp
+const uint64_t SEED = 42;
+
+struct Tables {
+    ColumnTable customer, orders, lineitem, supplier, nation, region;
+};
+
+// A fresh directory under the system temp directory, removed with everything in it
+class TempDir {
+public:
+    TempDir() {
+        std::string pattern = (std::filesystem::temp_directory_path() / "query5_test.XXXXXX").string();
+        if (::mkdtemp(&pattern[0])) path_ = pattern;
+    }
+    ~TempDir() {
+        std::error_code ignored;
+        if (!path_.empty()) std::filesystem::remove_all(path_, ignored);
+    }
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    bool ok() const { return !path_.empty(); }
+    std::string file(const std::string& name) const { return path_ + "/" + name; }
+
+private:
+    std::string path_;
+};
+
+const std::string& stringAt(const Column& column, size_t row) { return column.dictionary[column.ints[row]]; }
+
+// "YYYY-MM-DD" of a Date value, through the C library rather than the engine's date code
+std::string dayString(int32_t days) {
+    const std::time_t seconds = static_cast<std::time_t>(days) * 86400;
+    std::tm tm_utc;
+    gmtime_r(&seconds, &tm_utc);
+    char buffer[16];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d", &tm_utc);
+    return buffer;
+}
+
+// Query 5 as the SQL reads, one row at a time: the lineitems of orders placed in [start, end) by a
+// customer of a nation in r_name, supplied from that same nation, summed per nation name. Revenue is
+// l_extendedprice * (1 - l_discount) in cents times hundredths, i.e. scaled by REVENUE_SCALE.
+std::map<std::string, Revenue> naiveQuery5(const Query5Params& query, const Tables& t) {
+    std::set<int32_t> regions;
+    for (size_t row = 0; row < t.region.num_rows; ++row) {
+        if (stringAt(t.region.column("r_name"), row) == query.r_name) regions.insert(t.region.column("r_regionkey").ints[row]);
+    }
+    std::map<int32_t, std::string> nation_names; // nations of the region
+    for (size_t row = 0; row < t.nation.num_rows; ++row) {
+        if (regions.count(t.nation.column("n_regionkey").ints[row])) {
+            nation_names[t.nation.column("n_nationkey").ints[row]] = stringAt(t.nation.column("n_name"), row);
+        }
+    }
+    std::map<int32_t, int32_t> customer_nation;
+    for (size_t row = 0; row < t.customer.num_rows; ++row) {
+        customer_nation[t.customer.column("c_custkey").ints[row]] = t.customer.column("c_nationkey").ints[row];
+    }
+    std::map<int32_t, int32_t> supplier_nation;
+    for (size_t row = 0; row < t.supplier.num_rows; ++row) {
+        supplier_nation[t.supplier.column("s_suppkey").ints[row]] = t.supplier.column("s_nationkey").ints[row];
+    }
+    std::map<int32_t, int32_t> order_customer; // orders placed in the date range
+    for (size_t row = 0; row < t.orders.num_rows; ++row) {
+        const std::string date = dayString(t.orders.column("o_orderdate").ints[row]);
+        if (date >= query.start_date && date < query.end_date) {
+            order_customer[t.orders.column("o_orderkey").ints[row]] = t.orders.column("o_custkey").ints[row];
+        }
+    }
+
+    std::map<std::string, Revenue> revenue;
+    for (size_t row = 0; row < t.lineitem.num_rows; ++row) {
+        const auto order = order_customer.find(t.lineitem.column("l_orderkey").ints[row]);
+        if (order == order_customer.end()) continue;
+        const auto customer = customer_nation.find(order->second);
+        const auto supplier = supplier_nation.find(t.lineitem.column("l_suppkey").ints[row]);
+        if (customer == customer_nation.end() || supplier == supplier_nation.end() || customer->second != supplier->second) {
+            continue;
+        }
+        const auto nation = nation_names.find(supplier->second);
+        if (nation == nation_names.end()) continue;
+        const int64_t price = t.lineitem.column("l_extendedprice").decimals[row];
+        const int64_t discount = t.lineitem.column("l_discount").decimals[row];
+        revenue[nation->second] += price * (100 - discount);
+    }
+    return revenue;
+}
+
+// The text outputResults should write for `results`: by revenue descending, then by name, each line
+// after `prefix`
+std::string naiveOutput(const std::map<std::string, Revenue>& results, const std::string& prefix = "") {
+    std::vector<std::pair<std::string, Revenue>> rows(results.begin(), results.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    std::string text;
+    char buffer[64];
+    for (const auto& row : rows) {
+        std::snprintf(buffer, sizeof(buffer), "|%" PRId64 ".%04" PRId64 "\n", row.second / 10000, row.second % 10000);
+        text += prefix + row.first + buffer;
+    }
+    return text;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+// Whether `loaded` holds the rows of `generated`, comparing strings by value rather than by code.
+// Each dictionary value must appear once.
+bool sameRows(const ColumnTable& loaded, const ColumnTable& generated) {
+    if (loaded.num_rows != generated.num_rows || loaded.columns.size() != generated.columns.size()) return false;
+    for (size_t c = 0; c < loaded.columns.size(); ++c) {
+        const Column& a = loaded.columns[c];
+        const Column& b = generated.columns[c];
+        if (a.name != b.name || a.type != b.type) return false;
+        if (a.type == ColumnType::Decimal) {
+            if (a.decimals != b.decimals) return false;
+        } else if (a.type != ColumnType::String) {
+            if (a.ints != b.ints) return false;
+        } else {
+            if (std::set<std::string>(a.dictionary.begin(), a.dictionary.end()).size() != a.dictionary.size()) return false;
+            for (size_t row = 0; row < loaded.num_rows; ++row) {
+                if (stringAt(a, row) != stringAt(b, row)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+// `text` with every line ended by "\r\n" if crlf is set, and without its final '|' unless final_bar is
+std::string rewriteLines(const std::string& text, bool crlf, bool final_bar) {
+    std::string out;
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = text.find('\n', begin);
+        if (end == std::string::npos) end = text.size();
+        size_t line_end = end;
+        if (!final_bar && line_end > begin && text[line_end - 1] == '|') --line_end;
+        out.append(text, begin, line_end - begin);
+        out += crlf ? "\r\n" : "\n";
+        begin = end + 1;
+    }
+    return out;
+}
+
+// loadTable must read `table`, written by writeTbl, back with either line ending, with or without
+// the '|' after the last field
+bool loadsLineVariants(const ColumnTable& table, const TempDir& dir, int num_threads) {
+    const std::string path = dir.file(table.schema->name + ".tbl");
+    if (!dir.ok() || !writeTbl(path, table)) return false;
+    const std::string text = readFile(path);
+    for (bool crlf : {false, true}) {
+        for (bool final_bar : {true, false}) {
+            std::ofstream(path, std::ios::binary | std::ios::trunc) << rewriteLines(text, crlf, final_bar);
+            ColumnTable loaded;
+            if (!loadTable(path, *table.schema, {}, loaded, num_threads) || !sameRows(loaded, table)) {
+                std::cerr << table.schema->name << ".tbl" << (crlf ? " with \\r\\n" : "")
+                          << (final_bar ? "" : " without the final '|'") << ": loaded wrong rows" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+const char* strategyName(JoinStrategy strategy) {
+    switch (strategy) {
+        case JoinStrategy::Auto: return "auto";
+        case JoinStrategy::Hash: return "hash";
+        case JoinStrategy::Radix: return "radix";
+        case JoinStrategy::Merge: return "merge";
+    }
+    return "?";
+}
+
+const char* choiceName(KernelChoice choice) {
+    return choice == KernelChoice::Auto ? "auto" : choice == KernelChoice::On ? "on" : "off";
+}
+
+// Rows [begin, end) of `table` with their zone maps
+ColumnTable sliceRows(const ColumnTable& table, size_t begin, size_t end) {
+    ColumnTable slice;
+    slice.schema = table.schema;
+    slice.num_rows = end - begin;
+    for (const Column& column : table.columns) {
+        Column part{column.name, column.type, {}, {}, column.dictionary, {}, {}, false};
+        if (!column.ints.empty()) part.ints.assign(column.ints.begin() + begin, column.ints.begin() + end);
+        if (!column.decimals.empty()) part.decimals.assign(column.decimals.begin() + begin, column.decimals.begin() + end);
+        slice.columns.push_back(std::move(part));
+    }
+    buildZoneMaps(slice);
+    return slice;
+}
+
+// First row of `table`, sorted by `key`, whose key is at least `value`
+size_t lowerBound(const ColumnTable& table, const std::string& key, int32_t value) {
+    const std::vector<int32_t>& keys = table.column(key).ints;
+    return static_cast<size_t>(std::lower_bound(keys.begin(), keys.end(), value) - keys.begin());
+}
+
+bool runAll(const std::vector<Query5Params>& queries, const Tables& t, int num_threads, const QueryPlan& plan,
+            std::vector<std::map<std::string, Revenue>>& results) {
+    results.assign(queries.size(), std::map<std::string, Revenue>());
+    for (size_t q = 0; q < queries.size(); ++q) {
+        if (!executeQuery5(queries[q].r_name, queries[q].start_date, queries[q].end_date, num_threads,
+                           t.customer, t.orders, t.lineitem, t.supplier, t.nation, t.region, results[q], plan)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Feeds the tables to a Query5Refresh as the first half of orders with their lineitems, then the
+// next quarter of orders with part of their lineitems, then the last quarter, then a lineitem-only
+// delta with the lineitems held back. dbgen order keeps both tables sorted by order key.
+bool runRefresh(const std::vector<Query5Params>& queries, const Tables& t, int num_threads, const QueryPlan& plan,
+                std::vector<std::map<std::string, Revenue>>& results) {
+    const size_t half = t.orders.num_rows / 2;
+    const size_t three_quarters = t.orders.num_rows * 3 / 4;
+    const std::vector<int32_t>& o_orderkey = t.orders.column("o_orderkey").ints;
+    const size_t l_half = lowerBound(t.lineitem, "l_orderkey", o_orderkey[half]);
+    const size_t l_three_quarters = lowerBound(t.lineitem, "l_orderkey", o_orderkey[three_quarters]);
+    const size_t l_held_back = (l_half + l_three_quarters) / 2;
+
+    const ColumnTable base_orders = sliceRows(t.orders, 0, half);
+    const ColumnTable base_lineitem = sliceRows(t.lineitem, 0, l_half);
+    Query5Refresh refresh;
+    if (!refresh.start(queries, num_threads, t.customer, base_orders, base_lineitem, t.supplier, t.nation, t.region, plan)) {
+        return false;
+    }
+    if (!refresh.apply(sliceRows(t.orders, half, three_quarters), sliceRows(t.lineitem, l_half, l_held_back)) ||
+        !refresh.apply(sliceRows(t.orders, three_quarters, t.orders.num_rows),
+                       sliceRows(t.lineitem, l_three_quarters, t.lineitem.num_rows)) ||
+        !refresh.apply(ColumnTable(), sliceRows(t.lineitem, l_held_back, l_three_quarters))) {
+        return false;
+    }
+    refresh.results(results);
+    return true;
+}
+
+// Chunks of a multi-chunk load are parsed with their own dictionaries, which are merged afterwards:
+// the codes of the loaded lineitem.tbl must still decode to the generated strings
+bool loadsChunks(const ColumnTable& lineitem, const TempDir& dir, const std::vector<int>& thread_counts) {
+    const std::string path = dir.file("lineitem.tbl");
+    if (!dir.ok() || !writeTbl(path, lineitem)) return false;
+    if (std::filesystem::file_size(path) < 2 * LOAD_CHUNK_BYTES) {
+        std::cerr << "lineitem.tbl is too small for a multi-chunk load" << std::endl;
+        return false;
+    }
+    for (int num_threads : thread_counts) {
+        ColumnTable loaded;
+        if (!loadTable(path, LINEITEM_SCHEMA, {}, loaded, num_threads) || !sameRows(loaded, lineitem)) {
+            std::cerr << "lineitem.tbl loaded in chunks with " << num_threads << " threads: wrong rows" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// executeQuery5Streaming over a lineitem.tbl of several chunks, in generated order and with its lines
+// reversed, must give the naive result with every join strategy and number of threads
+bool streamsLineitem(const std::vector<Query5Params>& queries, const Tables& t, const TempDir& dir,
+                     const std::vector<int>& thread_counts) {
+    std::vector<std::map<std::string, Revenue>> expected;
+    for (const Query5Params& query : queries) expected.push_back(naiveQuery5(query, t));
+    const std::string path = dir.file("stream_lineitem.tbl");
+    if (!dir.ok() || !writeTbl(path, t.lineitem)) return false;
+    const std::string text = readFile(path);
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    for (std::string line; std::getline(in, line);) lines.push_back(line + "\n");
+    std::string reversed;
+    for (auto line = lines.rbegin(); line != lines.rend(); ++line) reversed += *line;
+
+    for (bool sorted : {true, false}) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << (sorted ? text : reversed);
+        for (int num_threads : thread_counts) {
+            for (JoinStrategy strategy : {JoinStrategy::Auto, JoinStrategy::Hash, JoinStrategy::Radix, JoinStrategy::Merge}) {
+                std::vector<std::map<std::string, Revenue>> results;
+                if (!executeQuery5Streaming(path, queries, num_threads, t.customer, t.orders, t.supplier, t.nation, t.region,
+                                            results, QueryPlan{strategy, ProbeKernelOptions()}) ||
+                    results != expected) {
+                    std::cerr << "Streaming " << (sorted ? "sorted" : "reversed") << " lineitem with " << num_threads
+                              << " threads, join " << strategyName(strategy) << ": wrong results" << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// A batch with a comment, an empty line and a bad line: runQuery5Batch must report the bad line and
+// write the result of every good one, in order, whether the queries share scans or run one by one,
+// and into one file per query when result_path is a directory
+bool runsBatch(const std::vector<Query5Params>& queries, const std::vector<std::map<std::string, Revenue>>& expected,
+               const Tables& t, const TempDir& dir, int num_threads) {
+    std::string batch = "# Query 5 batch\n\n";
+    std::string combined;
+    for (size_t q = 0; q < queries.size(); ++q) {
+        const std::string line = queries[q].r_name + "|" + queries[q].start_date + "|" + queries[q].end_date;
+        batch += line + "\n";
+        combined += naiveOutput(expected[q], line + "|");
+        if (q == 0) batch += "ASIA|1994-13-01|1995-01-01\n";
+    }
+    const std::string result_path = dir.file("batch.txt");
+    for (size_t queries_per_scan : {size_t(1), size_t(2), MAX_SHARED_QUERIES}) {
+        std::istringstream lines(batch);
+        if (runQuery5Batch(lines, result_path, num_threads, t.customer, t.orders, t.lineitem, t.supplier, t.nation,
+                           t.region, queries_per_scan) ||
+            readFile(result_path) != combined) {
+            std::cerr << "Batch of " << queries_per_scan << " queries per scan: wrong results or no error" << std::endl;
+            return false;
+        }
+    }
+    const std::string result_dir = dir.file("batch");
+    std::filesystem::create_directory(result_dir);
+    std::istringstream lines(batch);
+    if (runQuery5Batch(lines, result_dir, num_threads, t.customer, t.orders, t.lineitem, t.supplier, t.nation, t.region)) {
+        std::cerr << "Batch into a directory: no error for the bad line" << std::endl;
+        return false;
+    }
+    for (size_t q = 0; q < queries.size(); ++q) {
+        const std::string name = "q5_" + queries[q].r_name + "_" + queries[q].start_date + "_" + queries[q].end_date + ".txt";
+        if (readFile(result_dir + "/" + name) != naiveOutput(expected[q])) {
+            std::cerr << "Batch into a directory: wrong " << name << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every way of probing a lineitem table without l_discount must return false
+bool rejectsMissingColumn(const std::vector<Query5Params>& queries, const Tables& t, int num_threads) {
+    ColumnTable lineitem = sliceRows(t.lineitem, 0, t.lineitem.num_rows / 2);
+    lineitem.columns.erase(std::find_if(lineitem.columns.begin(), lineitem.columns.end(),
+                                        [](const Column& c) { return c.name == "l_discount"; }));
+    std::vector<std::map<std::string, Revenue>> results;
+    if (executeQuery5Shared(queries, num_threads, t.customer, t.orders, lineitem, t.supplier, t.nation, t.region, results)) {
+        return false;
+    }
+    Query5Refresh refresh;
+    if (refresh.start(queries, num_threads, t.customer, t.orders, lineitem, t.supplier, t.nation, t.region)) return false;
+    const ColumnTable no_lineitem = sliceRows(t.lineitem, 0, 0);
+    if (!refresh.start(queries, num_threads, t.customer, t.orders, no_lineitem, t.supplier, t.nation, t.region)) return false;
+    return !refresh.apply(ColumnTable(), lineitem);
+}
+
+} // namespace
+
+int main() {
+    const int max_threads = static_cast<int>(std::max(3u, std::thread::hardware_concurrency()));
+    Tables t;
+    if (!generateTPCHData(SCALE_FACTOR, SEED, max_threads, t.customer, t.orders, t.lineitem, t.supplier, t.nation, t.region)) {
+        std::cerr << "Failed to generate data" << std::endl;
+        return 1;
+    }
+    const std::vector<Query5Params> queries = {
+        {"ASIA", "1994-01-01", "1995-01-01"},
+        {"EUROPE", "1995-03-15", "1996-09-01"},
+        {"AMERICA", "1992-01-01", "1999-01-01"},
+    };
+
+    std::vector<std::map<std::string, Revenue>> expected;
+    for (const Query5Params& query : queries) expected.push_back(naiveQuery5(query, t));
+    if (std::any_of(expected.begin(), expected.end(), [](const auto& r) { return r.empty(); })) {
+        std::cerr << "The naive Query 5 matched nothing" << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+    auto check = [&](const std::string& what, bool ok, const std::vector<std::map<std::string, Revenue>>& results) {
+        if (!ok) {
+            std::cerr << what << ": failed to run" << std::endl;
+            ++failures;
+            return;
+        }
+        for (size_t q = 0; q < queries.size(); ++q) {
+            if (results[q] != expected[q]) {
+                std::cerr << what << ": wrong result for " << queries[q].r_name << " " << queries[q].start_date << " "
+                          << queries[q].end_date << std::endl;
+                ++failures;
+            }
+        }
+    };
+
+    const KernelChoice choices[] = {KernelChoice::Auto, KernelChoice::Off, KernelChoice::On};
+    for (int num_threads : {1, 2, max_threads}) {
+        for (JoinStrategy strategy : {JoinStrategy::Auto, JoinStrategy::Hash, JoinStrategy::Radix, JoinStrategy::Merge}) {
+            for (KernelChoice supplier_first : choices) {
+                for (KernelChoice direct_orders : choices) {
+                    for (KernelChoice bitmap_filter : choices) {
+                        const QueryPlan plan{strategy, ProbeKernelOptions{supplier_first, direct_orders, bitmap_filter}};
+                        const std::string what = std::to_string(num_threads) + " threads, join " + strategyName(strategy) +
+                                                 ", supplier_first " + choiceName(supplier_first) + ", direct_orders " +
+                                                 choiceName(direct_orders) + ", bitmap_filter " + choiceName(bitmap_filter);
+                        std::vector<std::map<std::string, Revenue>> results;
+                        check(what, runAll(queries, t, num_threads, plan, results), results);
+                        check(what + ", refresh", runRefresh(queries, t, num_threads, plan, results), results);
+                    }
+                }
+            }
+        }
+    }
+
+    TempDir dir;
+    for (size_t q = 0; q < queries.size(); ++q) {
+        const std::string path = dir.file("result_" + std::to_string(q) + ".txt");
+        if (!dir.ok() || !outputResults(path, expected[q]) || readFile(path) != naiveOutput(expected[q])) {
+            std::cerr << "outputResults wrote the wrong text for " << queries[q].r_name << std::endl;
+            ++failures;
+        }
+    }
+
+    Tables full;
+    if (!generateTPCHData(LOAD_SCALE_FACTOR, SEED, max_threads, full.customer, full.orders, full.lineitem, full.supplier,
+                          full.nation, full.region, {})) {
+        std::cerr << "Failed to generate data" << std::endl;
+        return 1;
+    }
+    for (const ColumnTable* table : {&full.orders, &full.nation}) {
+        if (!loadsLineVariants(*table, dir, 1)) ++failures;
+    }
+    if (!loadsChunks(full.lineitem, dir, {1, 2, max_threads})) ++failures;
+    if (!streamsLineitem(queries, full, dir, {1, 2, max_threads})) ++failures;
+
+    std::cerr << "Expect bad-query errors:" << std::endl;
+    if (!runsBatch(queries, expected, t, dir, max_threads)) ++failures;
+
+    std::cerr << "Expect missing-column errors:" << std::endl;
+    if (!rejectsMissingColumn(queries, t, max_threads)) {
+        std::cerr << "A lineitem without l_discount was not rejected" << std::endl;
+        ++failures;
+    }
+
+    if (failures != 0) {
+        std::cerr << failures << " mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "All join strategies and probe kernels agree with the naive Query 5" << std::endl;
+    return 0;
+}
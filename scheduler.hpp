@@ -0,0 +1,91 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+// Morsel-driven scheduling: work is cut into small fixed-size ranges ("morsels") that workers
+// claim from a shared atomic cursor until none are left. A worker that hits cheap morsels simply
+// claims more, so skewed selectivity does not leave threads idle the way static partitioning does.
+// Workers come from the persistent ThreadPool. With profiling on, each worker's busy time and item
+// count is added to the innermost open ProfilePhase.
+// parallelForNodeMorsels additionally keeps workers on the part of a table placed on their NUMA node.
+
+#include "numa.hpp"
+#include "profile.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+
+// Rows per morsel for the scan and probe phases
+const size_t MORSEL_ROWS = 32 * 1024;
+
+namespace detail {
+// Cursor over the morsels of one node's run, on its own cache line
+struct alignas(64) MorselCursor {
+    std::atomic<size_t> next{0};
+    size_t end = 0;
+};
+
+// [0, total) is split into num_nodes runs as in NumaPlacement::nodeRange. A worker claims morsels
+// from its own node's run first and then from the others, so every item is still processed once.
+template <typename Fn>
+void runMorsels(int num_workers, size_t total, size_t morsel_size, int num_nodes, Fn& fn) {
+    if (total == 0) return;
+    morsel_size = std::max<size_t>(morsel_size, 1);
+    const size_t num_morsels = (total + morsel_size - 1) / morsel_size;
+    const int workers = static_cast<int>(std::min<size_t>(std::max(num_workers, 1), num_morsels));
+
+    std::unique_ptr<MorselCursor[]> cursors(new MorselCursor[num_nodes]);
+    for (int node = 0; node < num_nodes; ++node) {
+        size_t begin;
+        NumaPlacement::nodeRange(total, morsel_size, node, num_nodes, begin, cursors[node].end);
+        cursors[node].next.store(begin, std::memory_order_relaxed);
+    }
+    auto run = [&](int worker_id) {
+        Profiler& profiler = Profiler::instance();
+        const bool profiling = profiler.enabled();
+        std::chrono::steady_clock::time_point start;
+        if (profiling) {
+            profiler.attachThread();
+            start = std::chrono::steady_clock::now();
+        }
+        size_t items = 0;
+        const int home = worker_id % num_nodes;
+        for (int n = 0; n < num_nodes; ++n) {
+            MorselCursor& cursor = cursors[(home + n) % num_nodes];
+            for (;;) {
+                const size_t begin = cursor.next.fetch_add(morsel_size, std::memory_order_relaxed);
+                if (begin >= cursor.end) break;
+                const size_t end = std::min(begin + morsel_size, cursor.end);
+                fn(worker_id, begin, end);
+                items += end - begin;
+            }
+        }
+        if (profiling) {
+            const double busy = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            profiler.addWorkerTime(worker_id, busy, items);
+        }
+    };
+
+    ThreadPool::instance().run(workers, run);
+}
+} // namespace detail
+
+// Calls fn(worker_id, begin, end) for consecutive ranges of at most morsel_size items covering
+// [0, total), using up to num_workers threads. The calling thread participates as worker 0 and
+// worker ids are dense in [0, num_workers), so callers can keep per-worker state in a vector.
+// Morsels are claimed in order, which loaders rely on for read-ahead.
+template <typename Fn>
+void parallelForMorsels(int num_workers, size_t total, size_t morsel_size, Fn fn) {
+    detail::runMorsels(num_workers, total, morsel_size, 1, fn);
+}
+
+// parallelForMorsels over a table placed with NumaPlacement::distribute (same morsel_size): with
+// --numa local, workers scan the run on their own node before helping with remote ones
+template <typename Fn>
+void parallelForNodeMorsels(int num_workers, size_t total, size_t morsel_size, Fn fn) {
+    detail::runMorsels(num_workers, total, morsel_size, NumaPlacement::instance().localNodes(), fn);
+}
+
+#endif // SCHEDULER_HPP
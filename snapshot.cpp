@@ -0,0 +1,202 @@
+#include "snapshot.hpp"
+#include "mapped_file.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'Q', '5', 'S', 'N', 'A', 'P', '\0', '\0'};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_columns;
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    uint64_t num_rows;
+};
+
+// Followed by the name, the values and the dictionary, each padded to 8 bytes.
+// The dictionary is dict_count uint32 lengths followed by the concatenated strings.
+struct ColumnHeader {
+    uint32_t type;
+    uint32_t name_length;
+    uint64_t dict_count;
+    uint64_t dict_bytes;
+};
+
+size_t padded(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+
+size_t valueWidth(ColumnType type) { return type == ColumnType::Decimal ? sizeof(int64_t) : sizeof(int32_t); }
+
+// Bounds-checked cursor over the mapped snapshot
+class Reader {
+public:
+    Reader(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    const char* take(size_t n) {
+        if (static_cast<size_t>(end_ - p_) < n) return nullptr;
+        const char* at = p_;
+        p_ += n;
+        return at;
+    }
+    // `count` values of `width` bytes, padded; checked before multiplying, so a corrupt count cannot wrap
+    const char* takeArray(uint64_t count, size_t width) {
+        if (count > static_cast<size_t>(end_ - p_) / width) return nullptr;
+        return take(padded(static_cast<size_t>(count) * width));
+    }
+    template <typename T>
+    bool read(T& out) {
+        const char* at = take(sizeof(T));
+        if (!at) return false;
+        std::memcpy(&out, at, sizeof(T));
+        return true;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+};
+
+void writePadding(std::ofstream& out, size_t n) {
+    static const char zeros[8] = {0};
+    out.write(zeros, padded(n) - n);
+}
+
+} // namespace
+
+bool statSource(const std::string& path, SourceStamp& stamp) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return false;
+    stamp.size = static_cast<uint64_t>(st.st_size);
+    stamp.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool readSnapshot(const std::string& snapshot_path, const SourceStamp& source, const TableSchema& schema,
+                  const std::vector<std::string>& columns, ColumnTable& table) {
+    MappedFile file(snapshot_path);
+    if (!file.ok()) return false;
+    Reader in(file.begin(), file.end());
+
+    FileHeader header;
+    if (!in.read(header) || std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) return false;
+    if (header.version != SNAPSHOT_VERSION || header.source_size != source.size ||
+        header.source_mtime_ns != source.mtime_ns || header.num_columns != columns.size()) {
+        return false;
+    }
+
+    ColumnTable loaded;
+    loaded.schema = &schema;
+    loaded.num_rows = header.num_rows;
+    for (size_t c = 0; c < columns.size(); ++c) {
+        ColumnHeader col_header;
+        if (!in.read(col_header)) return false;
+        const char* name = in.take(padded(col_header.name_length));
+        if (!name || std::string(name, col_header.name_length) != columns[c]) return false;
+
+        Column col;
+        col.name = columns[c];
+        col.type = static_cast<ColumnType>(col_header.type);
+        bool known_type = false;
+        for (const ColumnDef& def : schema.columns) {
+            if (def.name == col.name) known_type = def.type == col.type;
+        }
+        if (!known_type) return false;
+
+        const char* values = in.takeArray(header.num_rows, valueWidth(col.type));
+        if (!values) return false;
+        const size_t value_bytes = static_cast<size_t>(header.num_rows) * valueWidth(col.type);
+        if (col.type == ColumnType::Decimal) {
+            col.decimals.resize(header.num_rows);
+            if (value_bytes > 0) std::memcpy(col.decimals.data(), values, value_bytes);
+        } else {
+            col.ints.resize(header.num_rows);
+            if (value_bytes > 0) std::memcpy(col.ints.data(), values, value_bytes);
+        }
+
+        const char* lengths = in.takeArray(col_header.dict_count, sizeof(uint32_t));
+        const char* chars = in.takeArray(col_header.dict_bytes, 1);
+        if (!lengths || !chars) return false;
+        col.dictionary.reserve(col_header.dict_count);
+        uint64_t offset = 0;
+        for (uint64_t d = 0; d < col_header.dict_count; ++d) {
+            uint32_t length;
+            std::memcpy(&length, lengths + d * sizeof(uint32_t), sizeof(length));
+            if (offset + length > col_header.dict_bytes) return false;
+            col.dictionary.emplace_back(chars + offset, length);
+            offset += length;
+        }
+        // Codes index the dictionary during execution and output, so one out of range rejects the file
+        if (col.type == ColumnType::String) {
+            for (int32_t code : col.ints) {
+                if (code < 0 || static_cast<uint64_t>(code) >= col_header.dict_count) return false;
+            }
+        }
+        loaded.columns.push_back(std::move(col));
+    }
+
+    table = std::move(loaded);
+    return true;
+}
+
+bool writeSnapshot(const std::string& snapshot_path, const SourceStamp& source, const ColumnTable& table) {
+    const std::string temp_path = snapshot_path + ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Error creating snapshot: " << temp_path << std::endl;
+            return false;
+        }
+
+        FileHeader header;
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = SNAPSHOT_VERSION;
+        header.num_columns = static_cast<uint32_t>(table.columns.size());
+        header.source_size = source.size;
+        header.source_mtime_ns = source.mtime_ns;
+        header.num_rows = table.num_rows;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (const Column& col : table.columns) {
+            uint64_t dict_bytes = 0;
+            for (const std::string& value : col.dictionary) dict_bytes += value.size();
+            ColumnHeader col_header;
+            col_header.type = static_cast<uint32_t>(col.type);
+            col_header.name_length = static_cast<uint32_t>(col.name.size());
+            col_header.dict_count = col.dictionary.size();
+            col_header.dict_bytes = dict_bytes;
+            out.write(reinterpret_cast<const char*>(&col_header), sizeof(col_header));
+            out.write(col.name.data(), col.name.size());
+            writePadding(out, col.name.size());
+
+            const size_t value_bytes = table.num_rows * valueWidth(col.type);
+            if (col.type == ColumnType::Decimal) out.write(reinterpret_cast<const char*>(col.decimals.data()), value_bytes);
+            else out.write(reinterpret_cast<const char*>(col.ints.data()), value_bytes);
+            writePadding(out, value_bytes);
+
+            for (const std::string& value : col.dictionary) {
+                const uint32_t length = static_cast<uint32_t>(value.size());
+                out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            }
+            writePadding(out, col.dictionary.size() * sizeof(uint32_t));
+            for (const std::string& value : col.dictionary) out.write(value.data(), value.size());
+            writePadding(out, dict_bytes);
+        }
+
+        if (!out) {
+            std::cerr << "Error writing snapshot: " << temp_path << std::endl;
+            out.close();
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temp_path.c_str(), snapshot_path.c_str()) != 0) {
+        std::cerr << "Error renaming snapshot to " << snapshot_path << std::endl;
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
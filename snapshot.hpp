@@ -0,0 +1,35 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+// Binary snapshots of parsed ColumnTables, so later runs can skip parsing the .tbl files.
+// A snapshot is a versioned, native-endian image of the projected columns. It records the size
+// and mtime of the .tbl file it was built from and is rebuilt whenever those change.
+
+#include "query5.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bump whenever the file layout or the encoding of any column type changes
+const uint32_t SNAPSHOT_VERSION = 1;
+
+// Identity of a source .tbl file as recorded in its snapshot
+struct SourceStamp {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+};
+
+// Fills `stamp` from the file at `path`; returns false if it cannot be stat'ed
+bool statSource(const std::string& path, SourceStamp& stamp);
+
+// Loads `table` from the snapshot at `snapshot_path` if it is well formed, has the current version,
+// matches `source` and holds exactly `columns` of `schema`, every string code within its dictionary.
+// Returns false otherwise.
+bool readSnapshot(const std::string& snapshot_path, const SourceStamp& source, const TableSchema& schema,
+                  const std::vector<std::string>& columns, ColumnTable& table);
+
+// Writes `table` as a snapshot of `source`. The file is written under a temporary name and
+// renamed into place, so a concurrent reader never sees a partial snapshot.
+bool writeSnapshot(const std::string& snapshot_path, const SourceStamp& source, const ColumnTable& table);
+
+#endif // SNAPSHOT_HPP
@@ -0,0 +1,151 @@
+// Snapshot test, run by ctest: a table written by writeSnapshot reads back unchanged, and a snapshot
+// that is stale, truncated, has a row count whose byte size wraps around or holds a string code
+// outside its dictionary is rejected without throwing. readTPCHData must then parse the .tbl files
+// as if there were no snapshots.
+
+#include "snapshot.hpp"
+#include "tpch_gen.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+// Offsets into the snapshot of a table holding just n_name, as snapshot.cpp lays it out
+const size_t NUM_ROWS_OFFSET = 32;       // FileHeader::num_rows
+const size_t CODES_OFFSET = 40 + 24 + 8; // FileHeader, ColumnHeader and "n_name" padded to 8 bytes
+
+bool sameTable(const ColumnTable& a, const ColumnTable& b) {
+    if (a.num_rows != b.num_rows || a.columns.size() != b.columns.size()) return false;
+    for (size_t c = 0; c < a.columns.size(); ++c) {
+        const Column& x = a.columns[c];
+        const Column& y = b.columns[c];
+        if (x.name != y.name || x.type != y.type || x.ints != y.ints || x.decimals != y.decimals ||
+            x.dictionary != y.dictionary) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string readBytes(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void writeBytes(const std::string& path, const std::string& bytes) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+}
+
+template <typename T>
+void patch(std::string& bytes, size_t offset, T value) {
+    std::memcpy(&bytes[offset], &value, sizeof(value));
+}
+
+bool readTables(const std::string& table_path, const std::string& cache_dir, std::vector<ColumnTable>& tables) {
+    tables.assign(6, ColumnTable());
+    return readTPCHData(table_path, tables[0], tables[1], tables[2], tables[3], tables[4], tables[5], 2, QUERY5_COLUMNS,
+                        cache_dir);
+}
+
+} // namespace
+
+int main() {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / ("snapshot_test." + std::to_string(::getpid()));
+    std::filesystem::create_directories(dir / "tables");
+    std::filesystem::create_directories(dir / "cache");
+    int failures = 0;
+    auto expect = [&](bool ok, const char* what) {
+        if (!ok) {
+            std::cerr << what << std::endl;
+            ++failures;
+        }
+    };
+
+    ColumnTable customer, orders, lineitem, supplier, nation, region;
+    if (!generateTPCHData(0.01, 42, 2, customer, orders, lineitem, supplier, nation, region, {})) {
+        std::cerr << "Failed to generate data" << std::endl;
+        return 1;
+    }
+
+    const std::string path = (dir / "n_name.q5snap").string();
+    const SourceStamp stamp{12345, 67890};
+    ColumnTable names;
+    names.schema = &NATION_SCHEMA;
+    names.num_rows = nation.num_rows;
+    names.columns.push_back(nation.column("n_name"));
+    const std::vector<std::string> columns = {"n_name"};
+    if (!writeSnapshot(path, stamp, names)) {
+        std::cerr << "Failed to write a snapshot" << std::endl;
+        return 1;
+    }
+    const std::string bytes = readBytes(path);
+    int32_t first_code;
+    std::memcpy(&first_code, &bytes[CODES_OFFSET], sizeof(first_code));
+    if (first_code != names.columns[0].ints[0]) {
+        std::cerr << "The snapshot layout changed; update the offsets" << std::endl;
+        return 1;
+    }
+
+    ColumnTable read;
+    expect(readSnapshot(path, stamp, NATION_SCHEMA, columns, read) && sameTable(read, names), "Round trip changed the table");
+    expect(!readSnapshot(path, SourceStamp{stamp.size + 1, stamp.mtime_ns}, NATION_SCHEMA, columns, read),
+           "A stale snapshot was read");
+    expect(!readSnapshot(path, stamp, NATION_SCHEMA, {"n_comment"}, read), "A snapshot of other columns was read");
+
+    auto rejects = [&](const std::string& corrupt) {
+        const std::string corrupt_path = (dir / "corrupt.q5snap").string();
+        writeBytes(corrupt_path, corrupt);
+        ColumnTable table;
+        return !readSnapshot(corrupt_path, stamp, NATION_SCHEMA, columns, table);
+    };
+    expect(rejects(bytes.substr(0, bytes.size() / 2)), "A truncated snapshot was read");
+    std::string corrupt = bytes;
+    // 4 bytes per code: (num_rows + 2^62) * 4 wraps around to the true size
+    patch<uint64_t>(corrupt, NUM_ROWS_OFFSET, names.num_rows + (uint64_t(1) << 62));
+    expect(rejects(corrupt), "A snapshot whose size overflows was read");
+    corrupt = bytes;
+    patch<int32_t>(corrupt, CODES_OFFSET, static_cast<int32_t>(names.columns[0].dictionary.size()));
+    expect(rejects(corrupt), "A snapshot with a code past its dictionary was read");
+    corrupt = bytes;
+    patch<int32_t>(corrupt, CODES_OFFSET, -1);
+    expect(rejects(corrupt), "A snapshot with a negative code was read");
+
+    // readTPCHData falls back to parsing when its snapshots are corrupt
+    const std::string table_path = (dir / "tables").string();
+    const std::string cache_dir = (dir / "cache").string();
+    const std::pair<const char*, const ColumnTable*> files[] = {{"customer", &customer}, {"orders", &orders},
+                                                                 {"lineitem", &lineitem}, {"supplier", &supplier},
+                                                                 {"nation", &nation},     {"region", &region}};
+    bool written = true;
+    for (const auto& file : files) written = writeTbl(table_path + "/" + file.first + ".tbl", *file.second) && written;
+    std::vector<ColumnTable> parsed, cached, reparsed;
+    // The second load with cache_dir reads the snapshots the first one wrote
+    if (!written || !readTables(table_path, "", parsed) || !readTables(table_path, cache_dir, cached) ||
+        !readTables(table_path, cache_dir, cached)) {
+        std::cerr << "Failed to load the tables" << std::endl;
+        return 1;
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(cache_dir)) {
+        const std::string snapshot = readBytes(entry.path().string());
+        writeBytes(entry.path().string(), snapshot.substr(0, snapshot.size() / 2));
+    }
+    expect(readTables(table_path, cache_dir, reparsed), "Corrupt snapshots failed the load");
+    for (size_t t = 0; t < parsed.size(); ++t) {
+        expect(sameTable(cached[t], parsed[t]), "A table read from its snapshot differs from the parsed one");
+        expect(sameTable(reparsed[t], parsed[t]), "A table behind a corrupt snapshot differs from the parsed one");
+    }
+
+    std::filesystem::remove_all(dir);
+    if (failures != 0) {
+        std::cerr << failures << " failures" << std::endl;
+        return 1;
+    }
+    std::cout << "Snapshots round-trip and corrupt ones are rejected" << std::endl;
+    return 0;
+}
@@ -0,0 +1,208 @@
+#ifndef TBL_SCAN_HPP
+#define TBL_SCAN_HPP
+
+// Delimiter scanning and field parsers for '|' separated .tbl files.
+// The scanner classifies 64 bytes at a time into bitmasks of '|' and '\n' positions using
+// AVX2, SSE2 or NEON when the compiler targets them, with a portable scalar fallback.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+struct DelimiterMasks {
+    uint64_t pipes;    // bit i set if block[i] == '|'
+    uint64_t newlines; // bit i set if block[i] == '\n'
+};
+
+// Classifies the 64 bytes at `block`, which must all be readable
+inline DelimiterMasks scanBlock64(const char* block) {
+    DelimiterMasks masks;
+#if defined(__AVX2__)
+    const __m256i pipe = _mm256_set1_epi8('|');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    masks.pipes = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, pipe))) |
+                  (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, pipe)))) << 32);
+    masks.newlines = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, newline))) |
+                     (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, newline)))) << 32);
+#elif defined(__SSE2__)
+    const __m128i pipe = _mm_set1_epi8('|');
+    const __m128i newline = _mm_set1_epi8('\n');
+    masks.pipes = 0;
+    masks.newlines = 0;
+    for (int i = 0; i < 4; ++i) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        masks.pipes |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, pipe)))) << (16 * i);
+        masks.newlines |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)))) << (16 * i);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    // NEON has no movemask: AND each lane with its bit weight and add pairwise down to 16 bits
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t bit = vld1q_u8(weights);
+    masks.pipes = 0;
+    masks.newlines = 0;
+    for (int i = 0; i < 4; ++i) {
+        const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(block + 16 * i));
+        uint8x16_t p = vandq_u8(vceqq_u8(v, vdupq_n_u8('|')), bit);
+        uint8x16_t n = vandq_u8(vceqq_u8(v, vdupq_n_u8('\n')), bit);
+        p = vpaddq_u8(p, p);
+        p = vpaddq_u8(p, p);
+        p = vpaddq_u8(p, p);
+        n = vpaddq_u8(n, n);
+        n = vpaddq_u8(n, n);
+        n = vpaddq_u8(n, n);
+        masks.pipes |= static_cast<uint64_t>(vgetq_lane_u16(vreinterpretq_u16_u8(p), 0)) << (16 * i);
+        masks.newlines |= static_cast<uint64_t>(vgetq_lane_u16(vreinterpretq_u16_u8(n), 0)) << (16 * i);
+    }
+#else
+    masks.pipes = 0;
+    masks.newlines = 0;
+    for (int i = 0; i < 64; ++i) {
+        masks.pipes |= static_cast<uint64_t>(block[i] == '|') << i;
+        masks.newlines |= static_cast<uint64_t>(block[i] == '\n') << i;
+    }
+#endif
+    return masks;
+}
+
+// Walks the delimiters of [begin, end) in increasing order, classifying one 64-byte block at a time.
+// The final partial block is copied into a zero-padded buffer so no read goes past `end`.
+class DelimiterScanner {
+public:
+    DelimiterScanner(const char* begin, const char* end)
+        : begin_(begin), end_(end), tail_base_(begin + ((end - begin) & ~static_cast<ptrdiff_t>(63))) {
+        std::memset(tail_, 0, sizeof(tail_));
+        std::memcpy(tail_, tail_base_, end_ - tail_base_);
+    }
+
+    // First '|' or '\n' at or after p, or end if there is none
+    const char* next(const char* p) { return find<true>(p); }
+
+    // First '\n' at or after p, or end if there is none
+    const char* nextNewline(const char* p) { return find<false>(p); }
+
+private:
+    template <bool any_delimiter>
+    const char* find(const char* p) {
+        while (p < end_) {
+            const char* base = begin_ + ((p - begin_) & ~static_cast<ptrdiff_t>(63));
+            if (base != block_) {
+                masks_ = scanBlock64(base == tail_base_ ? tail_ : base);
+                block_ = base;
+            }
+            uint64_t m = (any_delimiter ? (masks_.pipes | masks_.newlines) : masks_.newlines) & (~0ULL << (p - base));
+            if (m) {
+                const char* hit = base + __builtin_ctzll(m);
+                return hit < end_ ? hit : end_;
+            }
+            p = base + 64;
+        }
+        return end_;
+    }
+
+    const char* begin_;
+    const char* end_;
+    const char* tail_base_;
+    const char* block_ = nullptr;
+    DelimiterMasks masks_ = {0, 0};
+    char tail_[64];
+};
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar (H. Hinnant's days_from_civil)
+inline int32_t daysFromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Inverse of daysFromCivil (H. Hinnant's civil_from_days)
+inline void civilFromDays(int32_t days, int& y, int& m, int& d) {
+    const int z = days + 719468;
+    const int era = (z >= 0 ? z : z - 146096) / 146097;
+    const int doe = z - era * 146097;
+    const int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp + (mp < 10 ? 3 : -9);
+    y = yoe + era * 400 + (m <= 2);
+}
+
+inline bool isDigit(char c) { return static_cast<unsigned>(c - '0') < 10; }
+
+// Parses a Y-M-D date in [b, e) into a day number; returns false if malformed.
+// The fixed YYYY-MM-DD layout used by dbgen is decoded without a loop.
+inline bool parseDate(const char* b, const char* e, int32_t& out) {
+    if (e - b == 10 && b[4] == '-' && b[7] == '-' && isDigit(b[0]) && isDigit(b[1]) && isDigit(b[2]) && isDigit(b[3]) &&
+        isDigit(b[5]) && isDigit(b[6]) && isDigit(b[8]) && isDigit(b[9])) {
+        const int y = (b[0] - '0') * 1000 + (b[1] - '0') * 100 + (b[2] - '0') * 10 + (b[3] - '0');
+        const int m = (b[5] - '0') * 10 + (b[6] - '0');
+        const int d = (b[8] - '0') * 10 + (b[9] - '0');
+        out = daysFromCivil(y, m, d);
+        return true;
+    }
+    int parts[3] = {0, 0, 0};
+    int part = 0;
+    bool has_digit = false;
+    for (const char* p = b; p < e; ++p) {
+        if (isDigit(*p)) {
+            parts[part] = parts[part] * 10 + (*p - '0');
+            has_digit = true;
+        } else if (*p == '-' && has_digit && part < 2) {
+            ++part;
+            has_digit = false;
+        } else {
+            return false;
+        }
+    }
+    if (part != 2 || !has_digit) return false;
+    out = daysFromCivil(parts[0], parts[1], parts[2]);
+    return true;
+}
+
+// Parses a (possibly signed) integer in [b, e)
+inline int32_t parseInt32(const char* b, const char* e) {
+    bool negative = false;
+    if (b < e && (*b == '-' || *b == '+')) negative = (*b++ == '-');
+    int32_t value = 0;
+    while (b < e && isDigit(*b)) value = value * 10 + (*b++ - '0');
+    return negative ? -value : value;
+}
+
+// Parses a decimal like "-123.45" in [b, e) into hundredths, truncating extra fraction digits.
+// Prices and discounts always have exactly two fraction digits, which takes the fast path.
+inline int64_t parseCents(const char* b, const char* e) {
+    bool negative = false;
+    if (b < e && (*b == '-' || *b == '+')) negative = (*b++ == '-');
+    int64_t value;
+    if (e - b >= 3 && e[-3] == '.' && isDigit(e[-2]) && isDigit(e[-1])) {
+        int64_t whole = 0;
+        for (const char* p = b; p < e - 3; ++p) whole = whole * 10 + (*p - '0');
+        value = whole * 100 + (e[-2] - '0') * 10 + (e[-1] - '0');
+    } else {
+        int64_t whole = 0;
+        while (b < e && isDigit(*b)) whole = whole * 10 + (*b++ - '0');
+        int64_t frac = 0;
+        if (b < e && *b == '.') {
+            ++b;
+            if (b < e && isDigit(*b)) frac += (*b++ - '0') * 10;
+            if (b < e && isDigit(*b)) frac += (*b++ - '0');
+        }
+        value = whole * 100 + frac;
+    }
+    return negative ? -value : value;
+}
+
+#endif // TBL_SCAN_HPP
@@ -0,0 +1,108 @@
+#include "thread_pool.hpp"
+#include "numa.hpp"
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace {
+// Set on pool threads, and on a caller while it runs worker 0's task, so nested run() calls do not
+// wait on the pool they are running in
+thread_local bool in_pool_worker = false;
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : threads_) t.join();
+}
+
+int ThreadPool::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(threads_.size());
+}
+
+void ThreadPool::setPinning(bool enabled) {
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    pinning_ = enabled;
+    for (size_t i = 0; i < threads_.size(); ++i) pin(threads_[i], static_cast<int>(i) + 1);
+}
+
+void ThreadPool::pin(std::thread& thread, int worker_id) {
+    const long num_cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus <= 0) return;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (pinning_) {
+        // NUMA placement spreads workers over nodes; otherwise worker i takes CPU i
+        const int numa_cpu = NumaPlacement::instance().workerCpu(worker_id);
+        CPU_SET(numa_cpu >= 0 ? numa_cpu : worker_id % num_cpus, &cpus);
+    } else {
+        for (long c = 0; c < num_cpus; ++c) CPU_SET(c, &cpus);
+    }
+    ::pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+}
+
+// Caller holds mutex_
+void ThreadPool::startWorkers(int count) {
+    while (static_cast<int>(threads_.size()) < count) {
+        const int worker_id = static_cast<int>(threads_.size()) + 1;
+        threads_.emplace_back(&ThreadPool::workerLoop, this, worker_id, generation_);
+        if (pinning_) pin(threads_.back(), worker_id);
+    }
+}
+
+// `seen` is the generation current when the worker was started, so a worker started by run()
+// takes part in that run's generation
+void ThreadPool::workerLoop(int worker_id, uint64_t seen) {
+    in_pool_worker = true;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) return;
+        seen = generation_;
+        if (worker_id >= active_workers_) continue;
+
+        const std::function<void(int)>* task = task_;
+        lock.unlock();
+        (*task)(worker_id);
+        lock.lock();
+        if (--pending_ == 0) done_.notify_one();
+    }
+}
+
+void ThreadPool::run(int num_workers, const std::function<void(int)>& task) {
+    if (num_workers <= 1 || in_pool_worker) {
+        for (int w = 0; w < std::max(num_workers, 1); ++w) task(w);
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        startWorkers(num_workers - 1);
+        task_ = &task;
+        active_workers_ = num_workers;
+        pending_ = num_workers - 1;
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    // run_mutex_ is held, so a run() from worker 0's task must execute inline like one from a pool thread
+    in_pool_worker = true;
+    task(0);
+    in_pool_worker = false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&] { return pending_ == 0; });
+    task_ = nullptr;
+}
@@ -0,0 +1,58 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+// Process-wide pool of persistent worker threads. Query execution and table loading submit work
+// to it instead of creating and joining std::threads on every call, so repeated queries in a
+// long-lived process pay no thread startup cost after the first one.
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // The shared pool; workers are started on first use and grown on demand
+    static ThreadPool& instance();
+
+    // When enabled, pool worker i is pinned to CPU i modulo the number of online CPUs, or to
+    // NumaPlacement::workerCpu(i) once NUMA placement is configured.
+    // Takes effect for running workers immediately and for workers started later.
+    void setPinning(bool enabled);
+
+    // Runs task(worker_id) for every worker_id in [0, num_workers) and waits for all of them.
+    // Worker 0 is the calling thread. run() calls from several threads are serialized, and a
+    // run() issued from inside a pool task executes its workers one after another inline.
+    // Tasks must not throw.
+    void run(int num_workers, const std::function<void(int)>& task);
+
+    // Number of pool threads started so far (not counting callers)
+    int size() const;
+
+    ~ThreadPool();
+
+private:
+    ThreadPool() = default;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void startWorkers(int count);
+    void workerLoop(int worker_id, uint64_t seen);
+    void pin(std::thread& thread, int worker_id);
+
+    std::mutex run_mutex_; // held for the duration of one run()
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::vector<std::thread> threads_; // threads_[i] is worker i + 1
+    const std::function<void(int)>* task_ = nullptr;
+    uint64_t generation_ = 0; // bumped for every run() that uses pool threads
+    int active_workers_ = 0;  // workers taking part in the current generation, including the caller
+    int pending_ = 0;         // pool workers of the current generation that have not finished
+    bool pinning_ = false;
+    bool stop_ = false;
+};
+
+#endif // THREAD_POOL_HPP
@@ -0,0 +1,44 @@
+// ThreadPool test, run by ctest: every worker id of a run() executes exactly once, and run() calls
+// nested in tasks, on the caller (worker 0) as on pool threads, execute inline instead of waiting
+// on the pool. A deadlock shows up as the ctest timeout.
+
+#include "thread_pool.hpp"
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+int main() {
+    ThreadPool& pool = ThreadPool::instance();
+    int failures = 0;
+
+    for (int workers : {1, 2, 5}) {
+        std::vector<std::atomic<int>> runs(workers);
+        pool.run(workers, [&](int worker_id) { ++runs[worker_id]; });
+        for (int w = 0; w < workers; ++w) {
+            if (runs[w] != 1) {
+                std::cerr << "run(" << workers << "): worker " << w << " ran " << runs[w] << " times" << std::endl;
+                ++failures;
+            }
+        }
+    }
+
+    std::atomic<int> inner_tasks{0};
+    pool.run(4, [&](int) { pool.run(3, [&](int) { ++inner_tasks; }); });
+    if (inner_tasks != 4 * 3) {
+        std::cerr << "nested run(): " << inner_tasks << " inner tasks instead of 12" << std::endl;
+        ++failures;
+    }
+
+    // The caller is no pool worker again once run() returns, so its next run() uses the pool threads
+    std::vector<std::thread::id> threads(2);
+    pool.run(2, [&](int worker_id) { threads[worker_id] = std::this_thread::get_id(); });
+    if (threads[0] != std::this_thread::get_id() || threads[1] == threads[0]) {
+        std::cerr << "run() after a nested run() did not use the pool threads" << std::endl;
+        ++failures;
+    }
+
+    if (failures != 0) return 1;
+    std::cout << "Thread pool runs and nests as documented" << std::endl;
+    return 0;
+}
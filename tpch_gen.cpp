@@ -0,0 +1,268 @@
+#include "tpch_gen.hpp"
+#include "scheduler.hpp"
+#include "tbl_scan.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+namespace {
+
+const char* const REGION_NAMES[] = {"AFRICA", "AMERICA", "ASIA", "EUROPE", "MIDDLE EAST"};
+
+// dbgen's nations and the regions they belong to
+const struct {
+    const char* name;
+    int32_t region;
+} NATIONS[] = {
+    {"ALGERIA", 0}, {"ARGENTINA", 1}, {"BRAZIL", 1}, {"CANADA", 1}, {"EGYPT", 4},
+    {"ETHIOPIA", 0}, {"FRANCE", 3}, {"GERMANY", 3}, {"INDIA", 2}, {"INDONESIA", 2},
+    {"IRAN", 4}, {"IRAQ", 4}, {"JAPAN", 2}, {"JORDAN", 4}, {"KENYA", 0},
+    {"MOROCCO", 0}, {"MOZAMBIQUE", 0}, {"PERU", 1}, {"CHINA", 2}, {"ROMANIA", 3},
+    {"SAUDI ARABIA", 4}, {"VIETNAM", 2}, {"RUSSIA", 3}, {"UNITED KINGDOM", 3}, {"UNITED STATES", 1}};
+const int32_t NUM_NATIONS = 25;
+
+// Values of the low-cardinality String columns; others get a single placeholder value
+const std::map<std::string, std::vector<std::string>> VOCABULARIES = {
+    {"c_mktsegment", {"AUTOMOBILE", "BUILDING", "FURNITURE", "HOUSEHOLD", "MACHINERY"}},
+    {"o_orderstatus", {"F", "O", "P"}},
+    {"o_orderpriority", {"1-URGENT", "2-HIGH", "3-MEDIUM", "4-NOT SPECIFIED", "5-LOW"}},
+    {"l_returnflag", {"R", "A", "N"}},
+    {"l_linestatus", {"O", "F"}},
+    {"l_shipinstruct", {"DELIVER IN PERSON", "COLLECT COD", "NONE", "TAKE BACK RETURN"}},
+    {"l_shipmode", {"REG AIR", "AIR", "RAIL", "SHIP", "TRUCK", "MAIL", "FOB"}}};
+const char* const PLACEHOLDER = "synthetic";
+
+// Codes into VOCABULARIES
+enum OrderStatus { STATUS_F, STATUS_O, STATUS_P };
+enum ReturnFlag { FLAG_R, FLAG_A, FLAG_N };
+enum LineStatus { LINE_O, LINE_F };
+
+// Salts that give every table its own random streams
+enum TableId : uint64_t { CUSTOMER_ID = 1, SUPPLIER_ID = 2, ORDERS_ID = 3 };
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Random stream of one row, determined by (seed, table, row) only
+class RowRandom {
+public:
+    RowRandom(uint64_t seed, TableId table, uint64_t row) : state_(splitmix64(seed ^ (table << 56) ^ splitmix64(row))) {}
+
+    // Uniform in [lo, hi]
+    int64_t uniform(int64_t lo, int64_t hi) {
+        state_ = splitmix64(state_);
+        return lo + static_cast<int64_t>(state_ % static_cast<uint64_t>(hi - lo + 1));
+    }
+
+private:
+    uint64_t state_;
+};
+
+// Writes generated fields into the projected columns of a table, in schema field order:
+// at(row) selects a row, then each put() stores the next field (an int32, day number, cents
+// or dictionary code, by the column's type) if that field is projected
+class RowWriter {
+public:
+    RowWriter(ColumnTable& table, const TableSchema& schema, const std::vector<std::string>& projection, size_t num_rows)
+        : columns_(schema.columns.size(), nullptr) {
+        table.schema = &schema;
+        table.num_rows = num_rows;
+        table.columns.clear();
+        table.columns.reserve(schema.columns.size());
+        std::vector<size_t> fields;
+        for (size_t i = 0; i < schema.columns.size(); ++i) {
+            const ColumnDef& def = schema.columns[i];
+            if (!projection.empty() && std::find(projection.begin(), projection.end(), def.name) == projection.end()) continue;
+            Column column{def.name, def.type, {}, {}, {}, {}, {}, false};
+            if (def.type == ColumnType::Decimal) column.decimals.resize(num_rows);
+            else column.ints.resize(num_rows);
+            if (def.type == ColumnType::String) {
+                auto vocabulary = VOCABULARIES.find(def.name);
+                column.dictionary = vocabulary != VOCABULARIES.end() ? vocabulary->second : std::vector<std::string>{PLACEHOLDER};
+            }
+            table.columns.push_back(std::move(column));
+            fields.push_back(i);
+        }
+        for (size_t c = 0; c < fields.size(); ++c) columns_[fields[c]] = &table.columns[c];
+    }
+
+    RowWriter& at(size_t row) {
+        row_ = row;
+        field_ = 0;
+        return *this;
+    }
+
+    RowWriter& put(int64_t value) {
+        Column* column = columns_[field_++];
+        if (column) {
+            if (column->type == ColumnType::Decimal) column->decimals[row_] = value;
+            else column->ints[row_] = static_cast<int32_t>(value);
+        }
+        return *this;
+    }
+
+    // The column of schema field `field`, or nullptr if it is not projected
+    Column* column(size_t field) const { return columns_[field]; }
+
+private:
+    std::vector<Column*> columns_; // by schema field
+    size_t row_ = 0;
+    size_t field_ = 0;
+};
+
+// dbgen's part retail price in cents
+int64_t retailPrice(int64_t partkey) {
+    return 90000 + ((partkey / 10) % 20001) + 100 * (partkey % 1000);
+}
+
+} // namespace
+
+bool generateTPCHData(double scale_factor, uint64_t seed, int num_threads,
+                      ColumnTable& customer_data,
+                      ColumnTable& orders_data,
+                      ColumnTable& lineitem_data,
+                      ColumnTable& supplier_data,
+                      ColumnTable& nation_data,
+                      ColumnTable& region_data,
+                      const std::vector<std::string>& projection) {
+    if (!(scale_factor > 0)) return false;
+    const int64_t num_customers = std::max<int64_t>(1, static_cast<int64_t>(150000 * scale_factor));
+    const int64_t num_suppliers = std::max<int64_t>(1, static_cast<int64_t>(10000 * scale_factor));
+    const int64_t num_parts = std::max<int64_t>(1, static_cast<int64_t>(200000 * scale_factor));
+    const int64_t num_orders = std::max<int64_t>(1, static_cast<int64_t>(1500000 * scale_factor));
+    const int32_t start_date = dateToDayNumber("1992-01-01");
+    const int32_t end_date = dateToDayNumber("1998-08-02");
+    const int32_t current_date = dateToDayNumber("1995-06-17");
+
+    RowWriter region(region_data, REGION_SCHEMA, projection, 5);
+    if (Column* r_name = region.column(1)) r_name->dictionary.assign(REGION_NAMES, REGION_NAMES + 5);
+    for (int32_t r = 0; r < 5; ++r) region.at(r).put(r).put(r).put(0);
+
+    RowWriter nation(nation_data, NATION_SCHEMA, projection, NUM_NATIONS);
+    if (Column* n_name = nation.column(1)) {
+        n_name->dictionary.clear();
+        for (const auto& n : NATIONS) n_name->dictionary.push_back(n.name);
+    }
+    for (int32_t n = 0; n < NUM_NATIONS; ++n) nation.at(n).put(n).put(n).put(NATIONS[n].region).put(0);
+
+    RowWriter supplier(supplier_data, SUPPLIER_SCHEMA, projection, num_suppliers);
+    parallelForMorsels(num_threads, num_suppliers, MORSEL_ROWS, [&](int, size_t begin, size_t end) {
+        RowWriter writer = supplier;
+        for (size_t i = begin; i < end; ++i) {
+            RowRandom rng(seed, SUPPLIER_ID, i);
+            writer.at(i).put(i + 1).put(0).put(0).put(rng.uniform(0, NUM_NATIONS - 1)).put(0)
+                .put(rng.uniform(-99999, 999999)).put(0);
+        }
+    });
+
+    RowWriter customer(customer_data, CUSTOMER_SCHEMA, projection, num_customers);
+    parallelForMorsels(num_threads, num_customers, MORSEL_ROWS, [&](int, size_t begin, size_t end) {
+        RowWriter writer = customer;
+        for (size_t i = begin; i < end; ++i) {
+            RowRandom rng(seed, CUSTOMER_ID, i);
+            writer.at(i).put(i + 1).put(0).put(0).put(rng.uniform(0, NUM_NATIONS - 1)).put(0)
+                .put(rng.uniform(-99999, 999999)).put(rng.uniform(0, 4)).put(0);
+        }
+    });
+
+    // Orders and their lineitems come from one random stream per order. The first pass draws only
+    // the line counts, so that every order's first lineitem row is known before rows are written.
+    std::vector<uint8_t> line_counts(num_orders);
+    parallelForMorsels(num_threads, num_orders, MORSEL_ROWS, [&](int, size_t begin, size_t end) {
+        for (size_t o = begin; o < end; ++o) line_counts[o] = static_cast<uint8_t>(RowRandom(seed, ORDERS_ID, o).uniform(1, 7));
+    });
+    std::vector<size_t> first_line(num_orders + 1, 0);
+    for (int64_t o = 0; o < num_orders; ++o) first_line[o + 1] = first_line[o] + line_counts[o];
+
+    // Customers with keys divisible by 3 place no orders, as in dbgen
+    const int64_t ordering_customers = num_customers - num_customers / 3;
+    RowWriter orders(orders_data, ORDERS_SCHEMA, projection, num_orders);
+    RowWriter lineitem(lineitem_data, LINEITEM_SCHEMA, projection, first_line[num_orders]);
+    parallelForMorsels(num_threads, num_orders, MORSEL_ROWS, [&](int, size_t begin, size_t end) {
+        RowWriter order_writer = orders;
+        RowWriter line_writer = lineitem;
+        for (size_t o = begin; o < end; ++o) {
+            RowRandom rng(seed, ORDERS_ID, o);
+            const int64_t lines = rng.uniform(1, 7);
+            const int64_t orderkey = static_cast<int64_t>(o / 8 * 32 + o % 8 + 1);
+            const int64_t c = rng.uniform(0, ordering_customers - 1);
+            const int64_t custkey = c / 2 * 3 + c % 2 + 1;
+            const int32_t orderdate = static_cast<int32_t>(rng.uniform(start_date, end_date - 151));
+            int64_t total_price = 0;
+            int shipped = 0;
+            for (int64_t l = 0; l < lines; ++l) {
+                const int64_t partkey = rng.uniform(1, num_parts);
+                // dbgen's supplier choice: one of four suppliers spread evenly over the key space
+                const int64_t i = rng.uniform(0, 3);
+                const int64_t suppkey = (partkey + i * (num_suppliers / 4 + (partkey - 1) / num_suppliers)) % num_suppliers + 1;
+                const int64_t quantity = rng.uniform(1, 50);
+                const int64_t extended_price = quantity * retailPrice(partkey);
+                const int64_t discount = rng.uniform(0, 10);
+                const int64_t tax = rng.uniform(0, 8);
+                const int32_t shipdate = orderdate + static_cast<int32_t>(rng.uniform(1, 121));
+                const int32_t commitdate = orderdate + static_cast<int32_t>(rng.uniform(30, 90));
+                const int32_t receiptdate = shipdate + static_cast<int32_t>(rng.uniform(1, 30));
+                const int64_t flag = receiptdate <= current_date ? (rng.uniform(0, 1) ? FLAG_R : FLAG_A) : FLAG_N;
+                const bool line_shipped = shipdate <= current_date;
+                shipped += line_shipped;
+                total_price += extended_price * (100 + tax) / 100 * (100 - discount) / 100;
+                line_writer.at(first_line[o] + l).put(orderkey).put(partkey).put(suppkey).put(l + 1).put(quantity * 100)
+                    .put(extended_price).put(discount).put(tax).put(flag).put(line_shipped ? LINE_F : LINE_O)
+                    .put(shipdate).put(commitdate).put(receiptdate).put(rng.uniform(0, 3)).put(rng.uniform(0, 6)).put(0);
+            }
+            const int64_t status = shipped == lines ? STATUS_F : shipped == 0 ? STATUS_O : STATUS_P;
+            order_writer.at(o).put(orderkey).put(custkey).put(status).put(total_price).put(orderdate)
+                .put(rng.uniform(0, 4)).put(0).put(0).put(0);
+        }
+    });
+
+    // Zone maps are built by the loaders; generated tables carry them too, so pruning behaves the same
+    for (ColumnTable* table : {&customer_data, &orders_data, &lineitem_data, &supplier_data, &nation_data, &region_data}) {
+        buildZoneMaps(*table, num_threads);
+    }
+    return true;
+}
+
+bool writeTbl(const std::string& path, const ColumnTable& table) {
+    if (!table.schema || table.columns.size() != table.schema->columns.size()) return false;
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+    std::string line;
+    char buffer[32];
+    for (size_t row = 0; row < table.num_rows; ++row) {
+        line.clear();
+        for (const Column& column : table.columns) {
+            switch (column.type) {
+                case ColumnType::Int32:
+                    line += std::to_string(column.ints[row]);
+                    break;
+                case ColumnType::Date: {
+                    int y, m, d;
+                    civilFromDays(column.ints[row], y, m, d);
+                    std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d", y, m, d);
+                    line += buffer;
+                    break;
+                }
+                case ColumnType::Decimal: {
+                    const int64_t value = column.decimals[row];
+                    const long long magnitude = value < 0 ? -value : value;
+                    std::snprintf(buffer, sizeof(buffer), "%s%lld.%02lld", value < 0 ? "-" : "", magnitude / 100, magnitude % 100);
+                    line += buffer;
+                    break;
+                }
+                case ColumnType::String:
+                    line += column.dictionary[column.ints[row]];
+                    break;
+            }
+            line += '|';
+        }
+        line += '\n';
+        out << line;
+    }
+    return static_cast<bool>(out);
+}
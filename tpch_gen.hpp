@@ -0,0 +1,31 @@
+#ifndef TPCH_GEN_HPP
+#define TPCH_GEN_HPP
+
+// In-process synthetic TPC-H data. Tables are filled directly in columnar form, without .tbl files,
+// with dbgen's cardinalities and key distributions: SF * 150000 customers, SF * 10000 suppliers,
+// SF * 1500000 orders with sparse keys (8 of every 32) placed by customers whose key is not a
+// multiple of 3, 1-7 lineitems per order, order dates in [1992-01-01, 1998-08-02 - 151 days],
+// and dbgen's price, discount and ship date ranges. The 25 nations and 5 regions are the real ones.
+// Every row is generated from (seed, table, row) alone, so the output does not depend on num_threads.
+// String columns that Query 5 does not read take values from small fixed vocabularies.
+
+#include "query5.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Generates the projected columns (all of them if `projection` is empty) of all six tables at
+// scale factor `scale_factor` using num_threads threads. Returns false if scale_factor <= 0.
+bool generateTPCHData(double scale_factor, uint64_t seed, int num_threads,
+                      ColumnTable& customer_data,
+                      ColumnTable& orders_data,
+                      ColumnTable& lineitem_data,
+                      ColumnTable& supplier_data,
+                      ColumnTable& nation_data,
+                      ColumnTable& region_data,
+                      const std::vector<std::string>& projection = QUERY5_COLUMNS);
+
+// Writes `table` as a '|' separated .tbl file. The table must hold every column of its schema.
+bool writeTbl(const std::string& path, const ColumnTable& table);
+
+#endif // TPCH_GEN_HPP